@@ -0,0 +1,107 @@
+/*
+	This file is part of NSEssentials.
+
+	Use of this source code is granted via a BSD-style license, which can be found
+	in License.txt in the repository root.
+
+	@author Nico Schertler
+*/
+
+//Measures how ConcurrentPersistentIndexContainer scales with the number of threads that insert and erase
+//entries concurrently, compared with a PersistentIndexContainer that is protected by a global mutex. Every
+//thread creates entries, writes them, and erases random ones of its own entries again. The total number of
+//operations is the same for all thread counts.
+//Usage: ConcurrentPersistentIndexBenchmark [operations] [max threads]
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <mutex>
+
+#include "nsessentials/data/ConcurrentPersistentIndexContainer.h"
+#include "nsessentials/util/Timer.h"
+
+using namespace nse;
+
+typedef util::Timer<std::chrono::microseconds> Timer;
+
+//Number of entries that every thread keeps alive on average
+static const size_t LiveEntriesPerThread = 4096;
+
+//Runs f(thread, operations) on the given number of threads and returns the time in microseconds.
+template <typename Func>
+static size_t runThreads(unsigned int threads, size_t operations, const Func& f)
+{
+	std::vector<std::thread> workers;
+	Timer timer;
+	for (unsigned int t = 0; t < threads; ++t)
+		workers.emplace_back(f, t, operations / threads);
+	for (auto& w : workers)
+		w.join();
+	return timer.value();
+}
+
+//Inserts or erases an entry of the thread. insert(), erase(), and write() perform the operations on the container.
+template <typename Insert, typename Erase, typename Write>
+static void churn(unsigned int thread, size_t operations, const Insert& insert, const Erase& erase, const Write& write)
+{
+	std::mt19937 rnd(thread);
+	std::vector<size_t> own;
+	for (size_t i = 0; i < operations; ++i)
+	{
+		if (own.size() < LiveEntriesPerThread || (rnd() & 1))
+		{
+			size_t index = insert();
+			write(index, (int)i);
+			own.push_back(index);
+		}
+		else
+		{
+			size_t j = rnd() % own.size();
+			erase(own[j]);
+			own[j] = own.back();
+			own.pop_back();
+		}
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	size_t operations = argc > 1 ? (size_t)atoll(argv[1]) : 1 << 23;
+	unsigned int maxThreads = argc > 2 ? (unsigned int)atoi(argv[2]) : 32;
+
+	printf("%zu operations, %u hardware threads, throughput in million operations per second\n", operations, std::thread::hardware_concurrency());
+	printf("threads  concurrent  global mutex  speedup\n");
+	for (unsigned int threads = 1; threads <= maxThreads; threads *= 2)
+	{
+		data::ConcurrentPersistentIndexContainer<int> concurrent;
+		size_t concurrentTime = runThreads(threads, operations, [&](unsigned int t, size_t n)
+		{
+			churn(t, n, [&]() { return concurrent.insert(); }, [&](size_t i) { concurrent.erase(i); },
+				[&](size_t i, int value) { concurrent[i] = value; });
+		});
+
+		data::PersistentIndexContainer<int> locked;
+		std::mutex mutex;
+		size_t lockedTime = runThreads(threads, operations, [&](unsigned int t, size_t n)
+		{
+			churn(t, n, [&]() { std::lock_guard<std::mutex> lock(mutex); return locked.insert(); },
+				[&](size_t i) { std::lock_guard<std::mutex> lock(mutex); locked.erase(i); },
+				[&](size_t i, int value) { std::lock_guard<std::mutex> lock(mutex); locked[i] = value; });
+		});
+
+		if (concurrent.sizeNotDeleted() != locked.sizeNotDeleted())
+		{
+			fprintf(stderr, "The containers do not have the same number of entries.\n");
+			return 1;
+		}
+
+		double concurrentRate = (double)operations / std::max<size_t>(1, concurrentTime);
+		double lockedRate = (double)operations / std::max<size_t>(1, lockedTime);
+		printf("%7u  %10.2f  %12.2f  %7.2f\n", threads, concurrentRate, lockedRate, concurrentRate / lockedRate);
+	}
+	return 0;
+}
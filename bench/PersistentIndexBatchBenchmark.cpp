@@ -0,0 +1,112 @@
+/*
+	This file is part of NSEssentials.
+
+	Use of this source code is granted via a BSD-style license, which can be found
+	in License.txt in the repository root.
+
+	@author Nico Schertler
+*/
+
+//Compares insert_n() and erase_many() of PersistentIndexContainer with calling insert() and erase() for
+//every element. Half of the slots of the container are deleted at random before, so inserted elements
+//fill scattered holes and erased elements are spread over the whole container.
+//Usage: PersistentIndexBatchBenchmark [slots]
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+
+#include "nsessentials/data/PersistentIndexContainer.h"
+#include "nsessentials/util/Timer.h"
+
+using namespace nse;
+
+typedef util::Timer<std::chrono::microseconds> Timer;
+typedef data::PersistentIndexContainer<int> Container;
+
+static double nanosecondsPer(size_t microseconds, size_t count)
+{
+	return 1000.0 * microseconds / std::max<size_t>(1, count);
+}
+
+static bool sameSlots(Container& a, Container& b)
+{
+	if (a.sizeWithGaps() != b.sizeWithGaps() || a.sizeNotDeleted() != b.sizeNotDeleted())
+		return false;
+	for (size_t i = 0; i < a.sizeWithGaps(); ++i)
+		if (a.isDeleted(i) != b.isDeleted(i))
+			return false;
+	return true;
+}
+
+int main(int argc, char* argv[])
+{
+	size_t slots = argc > 1 ? (size_t)atoll(argv[1]) : 1 << 20;
+	//every batch size processes about the same number of elements in total
+	const size_t elementsPerRun = std::max<size_t>(1, slots / 4);
+
+	std::mt19937 rnd(42);
+	Container fragmented;
+	for (size_t i = 0; i < slots; ++i)
+		fragmented[fragmented.insert()] = (int)i;
+	std::bernoulli_distribution deleteSlot(0.5);
+	for (size_t i = 0; i < slots; ++i)
+		if (deleteSlot(rnd))
+			fragmented.erase(i);
+
+	printf("%zu slots, %zu deleted, times in ns per element\n", slots, fragmented.sizeWithGaps() - fragmented.sizeNotDeleted());
+	printf("batch size  insert()  insert_n()  erase()  erase_many()\n");
+	for (size_t batchSize : { 16, 1024, 65536 })
+	{
+		size_t batches = std::max<size_t>(1, elementsPerRun / batchSize);
+		size_t elements = batches * batchSize;
+
+		//insertion into the holes
+		Container single = fragmented, batched = fragmented;
+		std::vector<size_t> singleIndices, batchedIndices;
+		singleIndices.reserve(elements);
+		Timer timer;
+		for (size_t b = 0; b < batches; ++b)
+			for (size_t i = 0; i < batchSize; ++i)
+				singleIndices.push_back(single.insert());
+		size_t insertTime = timer.reset();
+		for (size_t b = 0; b < batches; ++b)
+			batched.insert_n(batchSize, batchedIndices);
+		size_t insertNTime = timer.reset();
+		if (singleIndices != batchedIndices || !sameSlots(single, batched))
+		{
+			fprintf(stderr, "insert_n() does not match insert().\n");
+			return 1;
+		}
+
+		//erasure of random live entries in unsorted batches
+		std::vector<size_t> live;
+		for (auto it = fragmented.begin(); it != fragmented.end(); ++it)
+			live.push_back(it.index());
+		std::shuffle(live.begin(), live.end(), rnd);
+		elements = std::min(elements, live.size() / batchSize * batchSize);
+		batches = elements / batchSize;
+		single = fragmented;
+		batched = fragmented;
+		timer.reset();
+		for (size_t i = 0; i < elements; ++i)
+			single.erase(live[i]);
+		size_t eraseTime = timer.reset();
+		for (size_t b = 0; b < batches; ++b)
+			batched.erase_many(live.begin() + b * batchSize, live.begin() + (b + 1) * batchSize);
+		size_t eraseManyTime = timer.reset();
+		if (!sameSlots(single, batched))
+		{
+			fprintf(stderr, "erase_many() does not match erase().\n");
+			return 1;
+		}
+
+		printf("%10zu  %8.1f  %10.1f  %7.1f  %12.1f\n", batchSize,
+			nanosecondsPer(insertTime, singleIndices.size()), nanosecondsPer(insertNTime, batchedIndices.size()),
+			nanosecondsPer(eraseTime, elements), nanosecondsPer(eraseManyTime, elements));
+	}
+	return 0;
+}
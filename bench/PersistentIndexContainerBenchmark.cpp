@@ -0,0 +1,117 @@
+/*
+	This file is part of NSEssentials.
+
+	Use of this source code is granted via a BSD-style license, which can be found
+	in License.txt in the repository root.
+
+	@author Nico Schertler
+*/
+
+//Measures isDeleted() and the iteration over the entries of a PersistentIndexContainer whose deleted
+//slots are scattered randomly (high fragmentation). For comparison, isDeleted() is also measured on a
+//sorted list of empty intervals that is scanned linearly, which is how the container tracked deleted
+//slots before, and the iteration is compared with testing every slot individually.
+//Usage: PersistentIndexContainerBenchmark [slots]
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <deque>
+#include <random>
+#include <chrono>
+
+#include "nsessentials/data/PersistentIndexContainer.h"
+#include "nsessentials/util/Timer.h"
+
+using namespace nse;
+
+typedef util::Timer<std::chrono::microseconds> Timer;
+
+static bool isDeletedInIntervals(const std::deque<data::Interval>& emptySlots, size_t size, size_t index)
+{
+	if (index >= size)
+		return true;
+	for (auto& range : emptySlots)
+	{
+		if (index < range.lowerInclusive)
+			return false;
+		if (index < range.upperExclusive)
+			return true;
+	}
+	return false;
+}
+
+static double nanosecondsPer(size_t microseconds, size_t count)
+{
+	return 1000.0 * microseconds / std::max<size_t>(1, count);
+}
+
+int main(int argc, char* argv[])
+{
+	size_t slots = argc > 1 ? (size_t)atoll(argv[1]) : 1 << 20;
+	//the interval scan is O(number of gaps) per query, so it gets fewer queries
+	const size_t queries = 1 << 24;
+	const size_t intervalQueries = 1 << 10;
+
+	printf("%zu slots, times in ns per query or per slot\n", slots);
+	printf("deleted      gaps  isDeleted: bitmap  intervals  iteration: iterator  per slot\n");
+	for (double fraction : { 0.5, 0.9, 0.99 })
+	{
+		data::PersistentIndexContainer<int> container;
+		for (size_t i = 0; i < slots; ++i)
+			container[container.insert()] = (int)i;
+
+		std::mt19937 rnd(42);
+		std::bernoulli_distribution deleteSlot(fraction);
+		std::deque<data::Interval> emptySlots;
+		for (size_t i = 0; i < slots; ++i)
+		{
+			if (!deleteSlot(rnd))
+				continue;
+			container.erase(i);
+			if (!emptySlots.empty() && emptySlots.back().upperExclusive == i)
+				++emptySlots.back().upperExclusive;
+			else
+				emptySlots.emplace_back(i, i + 1);
+		}
+
+		std::vector<size_t> indices(queries);
+		std::uniform_int_distribution<size_t> slotDist(0, slots - 1);
+		for (auto& i : indices)
+			i = slotDist(rnd);
+
+		size_t foundIntervals = 0;
+		volatile size_t found = 0;
+		Timer timer;
+		for (size_t i : indices)
+			found = found + container.isDeleted(i);
+		size_t bitmapTime = timer.reset();
+		for (size_t q = 0; q < intervalQueries; ++q)
+			foundIntervals += isDeletedInIntervals(emptySlots, slots, indices[q]);
+		size_t intervalTime = timer.reset();
+
+		int64_t sum = 0, sumPerSlot = 0;
+		timer.reset();
+		for (auto& entry : container)
+			sum += entry;
+		size_t iterationTime = timer.reset();
+		for (size_t i = 0; i < container.sizeWithGaps(); ++i)
+			if (!container.isDeleted(i))
+				sumPerSlot += container[i];
+		size_t perSlotTime = timer.reset();
+
+		size_t expected = 0;
+		for (size_t q = 0; q < intervalQueries; ++q)
+			expected += container.isDeleted(indices[q]);
+		if (expected != foundIntervals || sum != sumPerSlot)
+		{
+			fprintf(stderr, "The results do not match.\n");
+			return 1;
+		}
+
+		printf("%6.0f%%  %8zu  %17.1f  %9.1f  %19.2f  %8.2f\n", 100 * fraction, emptySlots.size(),
+			nanosecondsPer(bitmapTime, queries), nanosecondsPer(intervalTime, intervalQueries),
+			nanosecondsPer(iterationTime, slots), nanosecondsPer(perSlotTime, slots));
+	}
+	return 0;
+}
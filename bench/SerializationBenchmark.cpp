@@ -0,0 +1,86 @@
+/*
+	This file is part of NSEssentials.
+
+	Use of this source code is granted via a BSD-style license, which can be found
+	in License.txt in the repository root.
+
+	@author Nico Schertler
+*/
+
+//Compares the throughput of the bulk path of saveToFile()/loadFromFile() for vectors of
+//bulk-serializable elements with writing and reading every element individually.
+//Usage: SerializationBenchmark [megabytes] [file]
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <chrono>
+#include <iostream>
+
+#include "nsessentials/data/Serialization.h"
+#include "nsessentials/util/Timer.h"
+
+using namespace nse;
+
+typedef util::Timer<std::chrono::microseconds> Timer;
+
+static double throughput(size_t bytes, size_t microseconds)
+{
+	return (double)bytes / std::max<size_t>(1, microseconds);
+}
+
+int main(int argc, char* argv[])
+{
+	size_t megabytes = argc > 1 ? (size_t)atoi(argv[1]) : 256;
+	const char* path = argc > 2 ? argv[2] : "SerializationBenchmark.bin";
+
+	std::vector<float> data(megabytes * 1024 * 1024 / sizeof(float));
+	for (size_t i = 0; i < data.size(); ++i)
+		data[i] = (float)i;
+	std::vector<float> loaded;
+	size_t bytes = data.size() * sizeof(float);
+
+	Timer timer;
+	FILE* f = fopen(path, "wb");
+	if (!f)
+	{
+		std::cerr << "Cannot open " << path << std::endl;
+		return 1;
+	}
+	size_t n = data.size();
+	data::saveToFile(n, f);
+	for (auto& v : data)
+		data::saveToFile(v, f);
+	fclose(f);
+	size_t elementSave = timer.reset();
+
+	f = fopen(path, "rb");
+	loaded.resize(data::loadSizeFromFile(f));
+	for (auto& v : loaded)
+		data::loadFromFile(v, f);
+	fclose(f);
+	size_t elementLoad = timer.reset();
+
+	f = fopen(path, "wb");
+	data::saveToFile(data, f);
+	fclose(f);
+	size_t bulkSave = timer.reset();
+
+	f = fopen(path, "rb");
+	data::loadFromFile(loaded, f);
+	fclose(f);
+	size_t bulkLoad = timer.reset();
+
+	remove(path);
+
+	if (loaded != data)
+	{
+		std::cerr << "The loaded data does not match." << std::endl;
+		return 1;
+	}
+
+	printf("%zu MB of floats\n", megabytes);
+	printf("per element: save %8.1f MB/s, load %8.1f MB/s\n", throughput(bytes, elementSave), throughput(bytes, elementLoad));
+	printf("bulk:        save %8.1f MB/s, load %8.1f MB/s\n", throughput(bytes, bulkSave), throughput(bytes, bulkLoad));
+	return 0;
+}
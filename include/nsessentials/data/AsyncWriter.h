@@ -0,0 +1,106 @@
+/*
+	This file is part of NSEssentials.
+
+	Use of this source code is granted via a BSD-style license, which can be found
+	in License.txt in the repository root.
+
+	@author Nico Schertler
+*/
+
+#pragma once
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <exception>
+
+#include "nsessentials/data/Serialization.h"
+#include "nsessentials/NSELibrary.h"
+
+namespace nse {
+	namespace data
+	{
+		//Writes data to a file on a background thread. Written data is either copied into a staging
+		//buffer or moved into the writer, such that the caller only pays for the copy. The amount of
+		//memory that is queued for writing is bounded; writes block while the limit is exceeded (large
+		//writes block before they are copied, only the staging buffer of 1 MiB is not accounted for).
+		//The writer is a Sink for saveToFile() (see Serialization.h), i.e., serializing an object into
+		//the writer snapshots it. Data must be written from a single thread.
+		class NSE_EXPORT AsyncFileWriter
+		{
+		public:
+			AsyncFileWriter(const std::string& path, size_t maxQueuedBytes = 256 * 1024 * 1024);
+			//Waits until all data is written and closes the file. Errors are only reported on stderr,
+			//so call close() explicitly to handle them.
+			~AsyncFileWriter();
+
+			AsyncFileWriter(const AsyncFileWriter&) = delete;
+			AsyncFileWriter& operator=(const AsyncFileWriter&) = delete;
+
+			//Copies the data into the staging buffer.
+			void write(const void* data, size_t bytes);
+
+			//Takes ownership of the buffer without copying.
+			void write(std::vector<char>&& buffer);
+
+			//Writes a vector in the format of saveToFile() and takes ownership of its data.
+			template <typename T, typename Allocator>
+			void writeVector(std::vector<T, Allocator>&& v)
+			{
+				static_assert(is_bulk_serializable<T>::value, "Only vectors of bulk-serializable types can be moved into the writer.");
+				size_t n = v.size();
+				write(&n, sizeof(size_t));
+				flushStaging();
+				auto owner = std::make_shared<std::vector<T, Allocator>>(std::move(v));
+				enqueue(std::shared_ptr<const void>(owner, owner->data()), n * sizeof(T));
+			}
+
+			//Returns a future that becomes ready once all data that has been written so far is
+			//on durable storage. The future holds an exception if writing failed.
+			std::shared_future<void> fence();
+
+			//Waits until all data is written, forces it to durable storage, and closes the file. Rethrows
+			//errors from the background thread.
+			void close();
+
+		private:
+			struct Item
+			{
+				std::shared_ptr<const void> data;
+				size_t bytes;
+				std::shared_ptr<std::promise<void>> fence;
+			};
+
+			void enqueue(std::shared_ptr<const void> data, size_t bytes);
+			//Blocks until bytes fit into the queue and accounts for them.
+			void reserveCapacity(size_t bytes);
+			void releaseCapacity(size_t bytes);
+			//Queues data whose capacity has been reserved.
+			void pushReserved(std::shared_ptr<const void> data, size_t bytes);
+			void flushStaging();
+			void waitForCapacity(std::unique_lock<std::mutex>& lock, size_t bytes);
+			void run();
+
+			FILE* file;
+			size_t maxQueuedBytes;
+
+			std::mutex mutex;
+			std::condition_variable queueChanged;
+			std::deque<Item> queue;
+			size_t queuedBytes;
+			bool closing;
+			std::exception_ptr error;
+
+			//small writes are collected here before they are queued
+			std::vector<char> staging;
+
+			std::thread worker;
+		};
+	}
+}
@@ -0,0 +1,256 @@
+/*
+	This file is part of NSEssentials.
+
+	Use of this source code is granted via a BSD-style license, which can be found
+	in License.txt in the repository root.
+
+	@author Nico Schertler
+*/
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace nse {
+	namespace data
+	{
+		//Returns the index of the lowest set bit. word must not be zero.
+		inline unsigned int countTrailingZeros(uint64_t word)
+		{
+#ifdef _MSC_VER
+			unsigned long index;
+			_BitScanForward64(&index, word);
+			return (unsigned int)index;
+#else
+			return (unsigned int)__builtin_ctzll(word);
+#endif
+		}
+
+		inline unsigned int popCount(uint64_t word)
+		{
+#ifdef _MSC_VER
+			return (unsigned int)__popcnt64(word);
+#else
+			return (unsigned int)__builtin_popcountll(word);
+#endif
+		}
+
+		//Dense bit set that stores one bit per slot in 64-bit words. Bits beyond size() are always zero.
+		class OccupancyBitmap
+		{
+		public:
+			OccupancyBitmap()
+				: _size(0)
+			{ }
+
+			size_t size() const { return _size; }
+
+			void clear()
+			{
+				_words.clear();
+				_size = 0;
+			}
+
+			//Resizes the bitmap. New bits are initialized with value.
+			void resize(size_t size, bool value = false)
+			{
+				if (size < _size)
+				{
+					_words.resize((size + 63) / 64);
+					if (size % 64 != 0)
+						_words.back() &= lowMask(size % 64);
+				}
+				else if (size > _size)
+				{
+					if (value)
+					{
+						if (_size % 64 != 0)
+							_words.back() |= ~lowMask(_size % 64);
+						_words.resize((size + 63) / 64, ~0ull);
+						if (size % 64 != 0)
+							_words.back() &= lowMask(size % 64);
+					}
+					else
+						_words.resize((size + 63) / 64, 0);
+				}
+				_size = size;
+			}
+
+			void push_back(bool value)
+			{
+				if (_size % 64 == 0)
+					_words.push_back(0);
+				if (value)
+					_words.back() |= 1ull << (_size % 64);
+				++_size;
+			}
+
+			bool test(size_t i) const { return (_words[i >> 6] >> (i & 63)) & 1; }
+			void set(size_t i) { _words[i >> 6] |= 1ull << (i & 63); }
+			void reset(size_t i) { _words[i >> 6] &= ~(1ull << (i & 63)); }
+
+			//Clears all bits in [begin, end).
+			void resetRange(size_t begin, size_t end)
+			{
+				while (begin < end && begin % 64 != 0)
+					reset(begin++);
+				for (; begin + 64 <= end; begin += 64)
+					_words[begin >> 6] = 0;
+				while (begin < end)
+					reset(begin++);
+			}
+
+			//Returns the index of the first set bit at or after from, or size() if there is none.
+			size_t findNextSet(size_t from) const
+			{
+				if (from >= _size)
+					return _size;
+				size_t w = from >> 6;
+				uint64_t word = _words[w] & (~0ull << (from & 63));
+				while (word == 0)
+				{
+					if (++w == _words.size())
+						return _size;
+					word = _words[w];
+				}
+				return (w << 6) + countTrailingZeros(word);
+			}
+
+			//Returns the index of the first cleared bit at or after from, or size() if there is none.
+			size_t findNextClear(size_t from) const
+			{
+				if (from >= _size)
+					return _size;
+				size_t w = from >> 6;
+				uint64_t word = ~_words[w] & (~0ull << (from & 63));
+				while (word == 0)
+				{
+					if (++w == _words.size())
+						return _size;
+					word = ~_words[w];
+				}
+				return std::min(_size, (w << 6) + countTrailingZeros(word));
+			}
+
+			//Returns the number of set bits.
+			size_t count() const
+			{
+				size_t result = 0;
+				for (auto w : _words)
+					result += popCount(w);
+				return result;
+			}
+
+			const std::vector<uint64_t>& words() const { return _words; }
+
+		private:
+			static uint64_t lowMask(size_t bits) { return (1ull << bits) - 1; }
+
+			std::vector<uint64_t> _words;
+			size_t _size;
+		};
+
+		//Bit set with summary levels on top of the bits. A bit in level k + 1 is set iff the
+		//corresponding word in level k is not zero. This allows to find the first set bit in
+		//O(log_64 n) and to set or reset bits in O(log_64 n) worst case and O(1) on average.
+		class HierarchicalBitmap
+		{
+		public:
+			HierarchicalBitmap()
+				: _size(0)
+			{ }
+
+			size_t size() const { return _size; }
+
+			void clear()
+			{
+				_levels.clear();
+				_size = 0;
+			}
+
+			//Resizes the bitmap. All bits must be cleared before shrinking. New bits are cleared.
+			void resize(size_t size)
+			{
+				_size = size;
+				size_t words = (size + 63) / 64;
+				size_t level = 0;
+				do
+				{
+					if (level == _levels.size())
+					{
+						//a new summary level has to reflect the bits that are already set below
+						_levels.emplace_back(words, 0);
+						if (level > 0)
+						{
+							const auto& below = _levels[level - 1];
+							for (size_t w = 0; w < below.size(); ++w)
+								if (below[w] != 0)
+									_levels[level][w >> 6] |= 1ull << (w & 63);
+						}
+					}
+					_levels[level].resize(words, 0);
+					words = (words + 63) / 64;
+					++level;
+				} while (_levels[level - 1].size() > 1);
+				_levels.resize(level);
+			}
+
+			void push_back(bool value)
+			{
+				resize(_size + 1);
+				if (value)
+					set(_size - 1);
+			}
+
+			bool test(size_t i) const { return (_levels[0][i >> 6] >> (i & 63)) & 1; }
+
+			void set(size_t i)
+			{
+				for (auto& level : _levels)
+				{
+					uint64_t& word = level[i >> 6];
+					bool wasEmpty = word == 0;
+					word |= 1ull << (i & 63);
+					if (!wasEmpty)
+						break;
+					i >>= 6;
+				}
+			}
+
+			void reset(size_t i)
+			{
+				for (auto& level : _levels)
+				{
+					uint64_t& word = level[i >> 6];
+					word &= ~(1ull << (i & 63));
+					if (word != 0)
+						break;
+					i >>= 6;
+				}
+			}
+
+			//Returns the index of the first set bit, or size() if there is none.
+			size_t findFirstSet() const
+			{
+				if (_size == 0 || _levels.back()[0] == 0)
+					return _size;
+				size_t i = 0;
+				for (size_t level = _levels.size(); level-- > 0; )
+					i = (i << 6) + countTrailingZeros(_levels[level][i]);
+				return i;
+			}
+
+		private:
+			//_levels[0] contains the bits, the last level consists of a single word
+			std::vector<std::vector<uint64_t>> _levels;
+			size_t _size;
+		};
+	}
+}
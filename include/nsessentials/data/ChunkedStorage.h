@@ -0,0 +1,175 @@
+/*
+	This file is part of NSEssentials.
+
+	Use of this source code is granted via a BSD-style license, which can be found
+	in License.txt in the repository root.
+
+	@author Nico Schertler
+*/
+
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <utility>
+#include <algorithm>
+
+#include "nsessentials/data/Serialization.h"
+
+namespace nse {
+	namespace data
+	{
+		//Array that stores its elements in chunks of 2^ChunkBits elements. Chunks are allocated with
+		//Allocator when they are needed and are never moved, so growing the array neither copies existing
+		//elements nor invalidates pointers to them. Indexing is O(1) with one additional indirection.
+		//Huge pages can be used by providing an allocator that returns them (a chunk of 2^16 elements of
+		//32 bytes spans exactly one 2 MiB page).
+		//Supports the subset of the std::vector interface that is used by PersistentIndexContainer.
+		template <typename T, typename Allocator = std::allocator<T>, size_t ChunkBits = 16>
+		class ChunkedStorage
+		{
+			typedef std::allocator_traits<Allocator> AllocatorTraits;
+
+		public:
+			typedef T value_type;
+			typedef Allocator allocator_type;
+
+			static const size_t ChunkSize = size_t(1) << ChunkBits;
+
+			ChunkedStorage()
+				: _size(0)
+			{ }
+
+			explicit ChunkedStorage(const Allocator& allocator)
+				: allocator(allocator), _size(0)
+			{ }
+
+			ChunkedStorage(const ChunkedStorage& copy)
+				: allocator(AllocatorTraits::select_on_container_copy_construction(copy.allocator)), _size(0)
+			{
+				reserve(copy._size);
+				for (size_t i = 0; i < copy._size; ++i)
+					emplace_back(copy[i]);
+			}
+
+			ChunkedStorage(ChunkedStorage&& other)
+				: allocator(std::move(other.allocator)), chunks(std::move(other.chunks)), _size(other._size)
+			{
+				other.chunks.clear();
+				other._size = 0;
+			}
+
+			ChunkedStorage& operator=(ChunkedStorage other)
+			{
+				swap(other);
+				return *this;
+			}
+
+			~ChunkedStorage()
+			{
+				clear();
+				shrink_to_fit();
+			}
+
+			size_t size() const { return _size; }
+			bool empty() const { return _size == 0; }
+			size_t capacity() const { return chunks.size() * ChunkSize; }
+			Allocator get_allocator() const { return allocator; }
+
+			T& operator[](size_t index) { return chunks[index >> ChunkBits][index & (ChunkSize - 1)]; }
+			const T& operator[](size_t index) const { return chunks[index >> ChunkBits][index & (ChunkSize - 1)]; }
+
+			template <typename... Args>
+			void emplace_back(Args&&... args)
+			{
+				if (_size == capacity())
+					allocateChunk();
+				AllocatorTraits::construct(allocator, &(*this)[_size], std::forward<Args>(args)...);
+				++_size;
+			}
+
+			void push_back(const T& value) { emplace_back(value); }
+
+			//Allocates chunks such that the array can hold at least n elements.
+			void reserve(size_t n)
+			{
+				while (capacity() < n)
+					allocateChunk();
+			}
+
+			void resize(size_t n)
+			{
+				reserve(n);
+				while (_size < n)
+					emplace_back();
+				while (_size > n)
+					AllocatorTraits::destroy(allocator, &(*this)[--_size]);
+			}
+
+			//Destroys all elements. The chunks are kept for reuse.
+			void clear() { resize(0); }
+
+			//Releases all chunks that do not contain elements.
+			void shrink_to_fit()
+			{
+				size_t usedChunks = (_size + ChunkSize - 1) / ChunkSize;
+				while (chunks.size() > usedChunks)
+				{
+					AllocatorTraits::deallocate(allocator, chunks.back(), ChunkSize);
+					chunks.pop_back();
+				}
+			}
+
+			void swap(ChunkedStorage& other)
+			{
+				std::swap(allocator, other.allocator);
+				chunks.swap(other.chunks);
+				std::swap(_size, other._size);
+			}
+
+			//Direct access to the chunks, e.g., for bulk operations.
+			size_t chunkCount() const { return chunks.size(); }
+			T* chunk(size_t i) { return chunks[i]; }
+			const T* chunk(size_t i) const { return chunks[i]; }
+
+		private:
+			void allocateChunk()
+			{
+				//reserve first such that the new chunk cannot leak
+				chunks.reserve(chunks.size() + 1);
+				chunks.push_back(AllocatorTraits::allocate(allocator, ChunkSize));
+			}
+
+			Allocator allocator;
+			std::vector<T*> chunks;
+			size_t _size;
+		};
+
+		template <typename T, typename Allocator, size_t ChunkBits>
+		const size_t ChunkedStorage<T, Allocator, ChunkBits>::ChunkSize;
+
+		//The file format is the same as for std::vector.
+		template <typename T, typename Allocator, size_t ChunkBits, typename Sink>
+		void saveToFile(const ChunkedStorage<T, Allocator, ChunkBits>& object, Sink& f)
+		{
+			size_t n = object.size();
+			saveToFile(n, f);
+			for (size_t c = 0; c * object.ChunkSize < n; ++c)
+				saveArrayToFile(object.chunk(c), std::min(object.ChunkSize, n - c * object.ChunkSize), f);
+		}
+
+		template <typename T, typename Allocator, size_t ChunkBits, typename Source>
+		void loadElementsFromFile(ChunkedStorage<T, Allocator, ChunkBits>& object, size_t n, Source& f)
+		{
+			object.resize(n);
+			for (size_t c = 0; c * object.ChunkSize < n; ++c)
+				loadArrayFromFile(object.chunk(c), std::min(object.ChunkSize, n - c * object.ChunkSize), f);
+		}
+
+		template <typename T, typename Allocator, size_t ChunkBits, typename Source>
+		void loadFromFile(ChunkedStorage<T, Allocator, ChunkBits>& object, Source& f)
+		{
+			loadElementsFromFile(object, loadSizeFromFile(f), f);
+		}
+	}
+}
@@ -0,0 +1,304 @@
+/*
+	This file is part of NSEssentials.
+
+	Use of this source code is granted via a BSD-style license, which can be found
+	in License.txt in the repository root.
+
+	@author Nico Schertler
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <stdexcept>
+#include <algorithm>
+
+#include "nsessentials/data/Serialization.h"
+#include "nsessentials/data/Streams.h"
+
+//Column-wise (struct-of-arrays) serialization of vectors of structs. The fields of a struct are
+//declared once by specializing ColumnLayout:
+//  template <> struct nse::data::ColumnLayout<Vertex>
+//  {
+//      template <typename Visitor>
+//      static void visit(Visitor& v)
+//      {
+//          v("position", &Vertex::position);
+//          v("normal", &Vertex::normal);
+//      }
+//  };
+//Vectors of such structs are then stored column by column with
+//  saveToFile(columns(vertices), f);
+//and can be loaded completely with loadFromFile(columns(vertices), f) or partially into separate arrays:
+//  std::vector<Eigen::Vector3f> positions;
+//  loadColumnsFromFile(f, column("position", positions));
+//The file format is:
+//  number of rows (uint64), number of columns (uint32), and for every column:
+//  name (uint32 length + characters), element size (uint32, 0 for non-bulk types), size of the column data in bytes (uint64), column data
+
+namespace nse {
+	namespace data
+	{
+		template <typename T>
+		struct ColumnLayout;
+
+		namespace detail
+		{
+			template <typename Sink>
+			void saveColumnHeader(const std::string& name, uint32_t elementSize, uint64_t bytes, Sink& f)
+			{
+				uint32_t length = (uint32_t)name.size();
+				saveToFile(length, f);
+				writeBytes(f, name.data(), length);
+				saveToFile(elementSize, f);
+				saveToFile(bytes, f);
+			}
+
+			template <typename Source>
+			void loadColumnHeader(std::string& name, uint32_t& elementSize, uint64_t& bytes, Source& f)
+			{
+				uint32_t length;
+				loadFromFile(length, f);
+				name.resize(length);
+				if (length > 0)
+					readBytes(f, &name[0], length);
+				loadFromFile(elementSize, f);
+				loadFromFile(bytes, f);
+			}
+
+			//Writes a single column. Elements are gathered into a staging buffer.
+			template <typename T, typename M, typename Sink>
+			void saveColumn(const T* rows, size_t n, M T::* member, Sink& f, std::true_type /* bulk */)
+			{
+				const size_t stagingSize = std::max<size_t>(1, SerializationStagingBytes / sizeof(M));
+				std::unique_ptr<M[]> staging(new M[std::min(n, stagingSize)]);
+				for (size_t start = 0; start < n; start += stagingSize)
+				{
+					size_t batch = std::min(n - start, stagingSize);
+					for (size_t i = 0; i < batch; ++i)
+						staging[i] = rows[start + i].*member;
+					writeBytes(f, staging.get(), batch * sizeof(M));
+				}
+			}
+
+			template <typename T, typename M, typename Sink>
+			void saveColumn(const T* rows, size_t n, M T::* member, Sink& f, std::false_type /* bulk */)
+			{
+				for (size_t i = 0; i < n; ++i)
+					saveToFile(rows[i].*member, f);
+			}
+
+			template <typename T, typename M, typename Source>
+			void loadColumn(T* rows, size_t n, M T::* member, Source& f, std::true_type /* bulk */)
+			{
+				const size_t stagingSize = std::max<size_t>(1, SerializationStagingBytes / sizeof(M));
+				std::unique_ptr<M[]> staging(new M[std::min(n, stagingSize)]);
+				for (size_t start = 0; start < n; start += stagingSize)
+				{
+					size_t batch = std::min(n - start, stagingSize);
+					readBytes(f, staging.get(), batch * sizeof(M));
+					for (size_t i = 0; i < batch; ++i)
+						rows[start + i].*member = staging[i];
+				}
+			}
+
+			template <typename T, typename M, typename Source>
+			void loadColumn(T* rows, size_t n, M T::* member, Source& f, std::false_type /* bulk */)
+			{
+				for (size_t i = 0; i < n; ++i)
+					loadFromFile(rows[i].*member, f);
+			}
+
+			template <typename M>
+			uint32_t columnElementSize() { return is_bulk_serializable<M>::value ? (uint32_t)sizeof(M) : 0; }
+
+			template <typename M>
+			void checkColumnElementSize(const std::string& name, uint32_t elementSize)
+			{
+				if (elementSize != columnElementSize<M>())
+					throw std::runtime_error("The type of column \"" + name + "\" does not match the stored data.");
+			}
+
+			template <typename T, typename Sink>
+			struct ColumnSaver
+			{
+				const T* rows;
+				size_t n;
+				Sink& f;
+
+				template <typename M>
+				void operator()(const char* name, M T::* member)
+				{
+					uint64_t bytes;
+					if (is_bulk_serializable<M>::value)
+					{
+						bytes = (uint64_t)n * sizeof(M);
+						saveColumnHeader(name, columnElementSize<M>(), bytes, f);
+						saveColumn(rows, n, member, f, is_bulk_serializable<M>());
+					}
+					else
+					{
+						//the size of the column is only known after serialization
+						MemorySink column;
+						saveColumn(rows, n, member, column, is_bulk_serializable<M>());
+						saveColumnHeader(name, columnElementSize<M>(), column.size(), f);
+						writeBytes(f, column.data(), column.size());
+					}
+				}
+			};
+
+			template <typename T, typename Source>
+			struct ColumnLoader
+			{
+				T* rows;
+				size_t n;
+				Source& f;
+				const std::string& name;
+				uint32_t elementSize;
+				bool found;
+
+				template <typename M>
+				void operator()(const char* memberName, M T::* member)
+				{
+					if (found || name != memberName)
+						return;
+					checkColumnElementSize<M>(name, elementSize);
+					loadColumn(rows, n, member, f, is_bulk_serializable<M>());
+					found = true;
+				}
+			};
+
+			struct ColumnCounter
+			{
+				uint32_t count;
+
+				template <typename T, typename M>
+				void operator()(const char*, M T::*) { ++count; }
+			};
+		}
+
+		//Wraps a vector of structs with a ColumnLayout such that it is serialized column by column.
+		template <typename Container>
+		struct Columns
+		{
+			Columns(Container& container) : container(container) { }
+			Container& container;
+		};
+
+		template <typename Container>
+		Columns<Container> columns(Container& container) { return Columns<Container>(container); }
+
+		template <typename T, typename Allocator, typename Sink>
+		void saveColumnsToFile(const std::vector<T, Allocator>& rows, Sink& f)
+		{
+			uint64_t n = rows.size();
+			saveToFile(n, f);
+			detail::ColumnCounter counter = { 0 };
+			ColumnLayout<T>::visit(counter);
+			saveToFile(counter.count, f);
+			detail::ColumnSaver<T, Sink> saver = { rows.data(), rows.size(), f };
+			ColumnLayout<T>::visit(saver);
+		}
+
+		template <typename T, typename Allocator, typename Sink>
+		void saveToFile(const Columns<std::vector<T, Allocator>>& object, Sink& f)
+		{
+			saveColumnsToFile(object.container, f);
+		}
+
+		template <typename T, typename Allocator, typename Sink>
+		void saveToFile(const Columns<const std::vector<T, Allocator>>& object, Sink& f)
+		{
+			saveColumnsToFile(object.container, f);
+		}
+
+		//Loads all stored columns that exist in the layout. Other columns are skipped; fields
+		//without stored column are value-initialized.
+		template <typename T, typename Allocator, typename Source>
+		void loadFromFile(Columns<std::vector<T, Allocator>> object, Source& f)
+		{
+			auto& rows = object.container;
+			uint64_t n;
+			uint32_t columnCount;
+			loadFromFile(n, f);
+			loadFromFile(columnCount, f);
+			rows.assign((size_t)n, T());
+
+			std::string name;
+			for (uint32_t c = 0; c < columnCount; ++c)
+			{
+				uint32_t elementSize;
+				uint64_t bytes;
+				detail::loadColumnHeader(name, elementSize, bytes, f);
+				detail::ColumnLoader<T, Source> loader = { rows.data(), rows.size(), f, name, elementSize, false };
+				ColumnLayout<T>::visit(loader);
+				if (!loader.found)
+					skipBytes(f, bytes);
+			}
+		}
+
+		//Target for loadColumnsFromFile() that receives a single column as a contiguous array.
+		template <typename M, typename Allocator>
+		struct ColumnTarget
+		{
+			std::string name;
+			std::vector<M, Allocator>& target;
+		};
+
+		template <typename M, typename Allocator>
+		ColumnTarget<M, Allocator> column(const std::string& name, std::vector<M, Allocator>& target)
+		{
+			return ColumnTarget<M, Allocator>{ name, target };
+		}
+
+		namespace detail
+		{
+			template <typename Source>
+			bool loadColumnIntoTarget(const std::string&, uint32_t, size_t, Source&)
+			{
+				return false;
+			}
+
+			template <typename Source, typename M, typename Allocator, typename... Rest>
+			bool loadColumnIntoTarget(const std::string& name, uint32_t elementSize, size_t n, Source& f,
+				ColumnTarget<M, Allocator>& target, Rest&... rest)
+			{
+				if (target.name != name)
+					return loadColumnIntoTarget(name, elementSize, n, f, rest...);
+				checkColumnElementSize<M>(name, elementSize);
+				target.target.resize(n);
+				if (is_bulk_serializable<M>::value)
+					readBytes(f, target.target.data(), n * sizeof(M));
+				else
+					for (auto& element : target.target)
+						loadFromFile(element, f);
+				return true;
+			}
+		}
+
+		//Loads the requested columns of data that has been stored with saveToFile(columns(...), f) into separate
+		//arrays. All other columns are skipped without deserializing them. Returns the number of rows.
+		template <typename Source, typename... Targets>
+		size_t loadColumnsFromFile(Source& f, Targets... targets)
+		{
+			uint64_t n;
+			uint32_t columnCount;
+			loadFromFile(n, f);
+			loadFromFile(columnCount, f);
+
+			std::string name;
+			for (uint32_t c = 0; c < columnCount; ++c)
+			{
+				uint32_t elementSize;
+				uint64_t bytes;
+				detail::loadColumnHeader(name, elementSize, bytes, f);
+				if (!detail::loadColumnIntoTarget(name, elementSize, (size_t)n, f, targets...))
+					skipBytes(f, bytes);
+			}
+			return (size_t)n;
+		}
+	}
+}
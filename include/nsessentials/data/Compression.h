@@ -0,0 +1,193 @@
+/*
+	This file is part of NSEssentials.
+
+	Use of this source code is granted via a BSD-style license, which can be found
+	in License.txt in the repository root.
+
+	@author Nico Schertler
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <stdexcept>
+
+#include "nsessentials/data/Serialization.h"
+#include "nsessentials/NSELibrary.h"
+
+namespace nse {
+	namespace data
+	{
+		struct CompressionOptions
+		{
+			//Size of the independently compressed chunks. Chunks are processed in parallel.
+			uint32_t chunkSize = 1 << 20;
+
+			//If greater than one, bytes are regrouped by their position within elements of
+			//this size before compression (byte shuffle). This usually improves the compression of
+			//floating point and integer arrays.
+			uint32_t shuffleTypeSize = 1;
+
+			//Maximum number of threads (0 = hardware concurrency)
+			unsigned int threads = 0;
+		};
+
+		//Collects the compression ratio and throughput of (de)compression operations.
+		struct CompressionStats
+		{
+			uint64_t uncompressedBytes = 0;
+			uint64_t compressedBytes = 0;
+			double seconds = 0;
+
+			double ratio() const { return compressedBytes == 0 ? 0.0 : (double)uncompressedBytes / compressedBytes; }
+			//Throughput in MB/s with respect to the uncompressed size
+			double throughput() const { return seconds == 0 ? 0.0 : uncompressedBytes / seconds / 1e6; }
+		};
+
+		//Compresses a memory block with a fast dependency-free LZ-style codec. The result
+		//is self-contained and is appended to out. Statistics are accumulated into stats.
+		NSE_EXPORT void compress(const void* data, size_t bytes, std::vector<char>& out,
+			const CompressionOptions& options = CompressionOptions(), CompressionStats* stats = nullptr);
+
+		//Returns the uncompressed size of a block that has been created with compress().
+		NSE_EXPORT uint64_t uncompressedSize(const char* compressed, size_t compressedBytes);
+
+		//Decompresses a block that has been created with compress(). out must be able to hold
+		//uncompressedSize() bytes. Returns the number of bytes of the compressed block.
+		NSE_EXPORT size_t decompress(const char* compressed, size_t compressedBytes, void* out, size_t outBytes,
+			unsigned int threads = 0, CompressionStats* stats = nullptr);
+
+		//Writes and reads a compressed block with a leading size.
+		template <typename Sink>
+		void saveCompressedToFile(const void* data, size_t bytes, Sink& f,
+			const CompressionOptions& options = CompressionOptions(), CompressionStats* stats = nullptr)
+		{
+			std::vector<char> buffer;
+			compress(data, bytes, buffer, options, stats);
+			saveToFile(buffer, f);
+		}
+
+		template <typename Source>
+		void loadCompressedFromFile(void* data, size_t bytes, Source& f,
+			unsigned int threads = 0, CompressionStats* stats = nullptr)
+		{
+			std::vector<char> buffer;
+			loadFromFile(buffer, f);
+			if (uncompressedSize(buffer.data(), buffer.size()) != bytes)
+				throw std::runtime_error("The compressed data does not have the expected size.");
+			decompress(buffer.data(), buffer.size(), data, bytes, threads, stats);
+		}
+
+		//Wraps a container such that it is compressed by saveToFile() and decompressed by loadFromFile().
+		//Supports std::vector and dense Eigen matrices of bulk-serializable types. Usage:
+		//  saveToFile(compressed(vertices), f);
+		//  loadFromFile(compressed(vertices), f);
+		template <typename Container>
+		struct Compressed
+		{
+			Compressed(Container& container, const CompressionOptions& options, CompressionStats* stats)
+				: container(container), options(options), stats(stats)
+			{ }
+
+			Container& container;
+			CompressionOptions options;
+			CompressionStats* stats;
+		};
+
+		//Compresses the container with byte shuffling for its element type.
+		template <typename Container>
+		Compressed<Container> compressed(Container& container, CompressionStats* stats = nullptr)
+		{
+			CompressionOptions options;
+			options.shuffleTypeSize = sizeof(*container.data());
+			return Compressed<Container>(container, options, stats);
+		}
+
+		template <typename Container>
+		Compressed<Container> compressed(Container& container, const CompressionOptions& options, CompressionStats* stats = nullptr)
+		{
+			return Compressed<Container>(container, options, stats);
+		}
+
+		template <typename T, typename Allocator, typename Sink>
+		void saveToFile(const Compressed<std::vector<T, Allocator>>& object, Sink& f)
+		{
+			static_assert(is_bulk_serializable<T>::value, "Only vectors of bulk-serializable types can be compressed.");
+			size_t n = object.container.size();
+			saveToFile(n, f);
+			saveCompressedToFile(object.container.data(), n * sizeof(T), f, object.options, object.stats);
+		}
+
+		template <typename T, typename Allocator, typename Sink>
+		void saveToFile(const Compressed<const std::vector<T, Allocator>>& object, Sink& f)
+		{
+			static_assert(is_bulk_serializable<T>::value, "Only vectors of bulk-serializable types can be compressed.");
+			size_t n = object.container.size();
+			saveToFile(n, f);
+			saveCompressedToFile(object.container.data(), n * sizeof(T), f, object.options, object.stats);
+		}
+
+		template <typename T, typename Allocator, typename Source>
+		void loadFromFile(Compressed<std::vector<T, Allocator>> object, Source& f)
+		{
+			static_assert(is_bulk_serializable<T>::value, "Only vectors of bulk-serializable types can be compressed.");
+			size_t n;
+			loadFromFile(n, f);
+			object.container.resize(n);
+			loadCompressedFromFile(object.container.data(), n * sizeof(T), f, object.options.threads, object.stats);
+		}
+
+#ifdef HAVE_EIGEN
+		template <typename Matrix, typename Sink>
+		void saveCompressedMatrixToFile(const Matrix& m, Sink& f, const CompressionOptions& options, CompressionStats* stats)
+		{
+			static_assert(is_bulk_serializable<typename Matrix::Scalar>::value, "Only matrices of bulk-serializable types can be compressed.");
+			if (Matrix::RowsAtCompileTime == Eigen::Dynamic)
+				saveToFile(m.rows(), f);
+			if (Matrix::ColsAtCompileTime == Eigen::Dynamic)
+				saveToFile(m.cols(), f);
+			if (m.IsRowMajor && m.rows() > 1 && m.cols() > 1)
+			{
+				Eigen::Matrix<typename Matrix::Scalar, Eigen::Dynamic, Eigen::Dynamic> colMajor = m;
+				saveCompressedToFile(colMajor.data(), colMajor.size() * sizeof(typename Matrix::Scalar), f, options, stats);
+			}
+			else
+				saveCompressedToFile(m.data(), m.size() * sizeof(typename Matrix::Scalar), f, options, stats);
+		}
+
+		template <typename T, int Rows, int Cols, int Options, int MaxRows, int MaxCols, typename Sink>
+		void saveToFile(const Compressed<Eigen::Matrix<T, Rows, Cols, Options, MaxRows, MaxCols>>& object, Sink& f)
+		{
+			saveCompressedMatrixToFile(object.container, f, object.options, object.stats);
+		}
+
+		template <typename T, int Rows, int Cols, int Options, int MaxRows, int MaxCols, typename Sink>
+		void saveToFile(const Compressed<const Eigen::Matrix<T, Rows, Cols, Options, MaxRows, MaxCols>>& object, Sink& f)
+		{
+			saveCompressedMatrixToFile(object.container, f, object.options, object.stats);
+		}
+
+		template <typename T, int Rows, int Cols, int Options, int MaxRows, int MaxCols, typename Source>
+		void loadFromFile(Compressed<Eigen::Matrix<T, Rows, Cols, Options, MaxRows, MaxCols>> object, Source& f)
+		{
+			static_assert(is_bulk_serializable<T>::value, "Only matrices of bulk-serializable types can be compressed.");
+			auto& m = object.container;
+			Eigen::Index rows = Rows, cols = Cols;
+			if (Rows == Eigen::Dynamic)
+				loadFromFile(rows, f);
+			if (Cols == Eigen::Dynamic)
+				loadFromFile(cols, f);
+			m.resize(rows, cols);
+			if (m.IsRowMajor && rows > 1 && cols > 1)
+			{
+				Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic> colMajor(rows, cols);
+				loadCompressedFromFile(colMajor.data(), colMajor.size() * sizeof(T), f, object.options.threads, object.stats);
+				m = colMajor;
+			}
+			else
+				loadCompressedFromFile(m.data(), m.size() * sizeof(T), f, object.options.threads, object.stats);
+		}
+#endif
+	}
+}
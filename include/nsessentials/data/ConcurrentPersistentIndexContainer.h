@@ -0,0 +1,335 @@
+/*
+	This file is part of NSEssentials.
+
+	Use of this source code is granted via a BSD-style license, which can be found
+	in License.txt in the repository root.
+
+	@author Nico Schertler
+*/
+
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <functional>
+#include <algorithm>
+#include <stdexcept>
+#include <cassert>
+#include <cstdint>
+
+#include "nsessentials/data/Serialization.h"
+#include "nsessentials/data/Bitmap.h"
+#include "nsessentials/data/PersistentIndexContainer.h"
+
+namespace nse {
+	namespace data
+	{
+		//Thread-safe variant of PersistentIndexContainer. insert(), erase(), operator[], and isDeleted() can be
+		//called concurrently from any number of threads. Accessing the same entry concurrently must still be
+		//synchronized by the caller. All other methods (iteration, clear, serialization) must not run concurrently
+		//with modifications.
+		//Entries are stored in chunks of 2^ChunkBits entries that are allocated on demand and never move. Each
+		//chunk has an atomic occupancy bitmap. Deleted slots are kept in StripeCount free lists; every thread
+		//uses the list that its id hashes to and only takes slots from other lists if its own list is empty.
+		//Indices are persistent, but unlike PersistentIndexContainer, insert() does not necessarily reuse the
+		//lowest deleted slot. The file format is the same as the one of PersistentIndexContainer.
+		template <typename T, typename Allocator = std::allocator<T>, size_t ChunkBits = 16>
+		class ConcurrentPersistentIndexContainer
+		{
+			typedef std::allocator_traits<Allocator> AllocatorTraits;
+
+			static const size_t ChunkSize = size_t(1) << ChunkBits;
+			static const size_t StripeCount = 64;
+
+			static_assert(ChunkBits >= 6, "A chunk must contain at least 64 entries.");
+
+		public:
+			//maxChunks limits the size of the container to maxChunks * 2^ChunkBits entries.
+			ConcurrentPersistentIndexContainer(size_t maxChunks = 65536, const Allocator& allocator = Allocator())
+				: allocator(allocator), maxChunks(maxChunks), chunks(new std::atomic<Chunk*>[maxChunks]), _size(0)
+			{
+				for (size_t i = 0; i < maxChunks; ++i)
+					chunks[i].store(nullptr, std::memory_order_relaxed);
+			}
+
+			ConcurrentPersistentIndexContainer(const ConcurrentPersistentIndexContainer&) = delete;
+			ConcurrentPersistentIndexContainer& operator=(const ConcurrentPersistentIndexContainer&) = delete;
+
+			~ConcurrentPersistentIndexContainer()
+			{
+				for (size_t i = 0; i < maxChunks; ++i)
+				{
+					Chunk* chunk = chunks[i].load(std::memory_order_relaxed);
+					if (chunk != nullptr)
+						destroyChunk(chunk);
+				}
+			}
+
+			//Returns the index of the new entry.
+			size_t insert()
+			{
+				size_t index;
+				if (!takeFreeSlot(index))
+				{
+					//the chunk is allocated before the slot is published, so every slot below _size has a
+					//chunk even if the allocation throws
+					index = _size.load();
+					do
+					{
+						if (index >= maxChunks * ChunkSize)
+							throw std::runtime_error("The capacity of the ConcurrentPersistentIndexContainer is exhausted.");
+						ensureChunk(index >> ChunkBits);
+					} while (!_size.compare_exchange_weak(index, index + 1));
+				}
+				chunk(index)->occupied[(index & (ChunkSize - 1)) >> 6].fetch_or(1ull << (index & 63), std::memory_order_release);
+				return index;
+			}
+
+			//Erases the entry. If several threads erase the same entry, only the first one releases the slot.
+			void erase(size_t index)
+			{
+				assert(!isDeleted(index));
+				Chunk* c = chunk(index);
+				uint64_t bit = 1ull << (index & 63);
+				uint64_t old = c->occupied[(index & (ChunkSize - 1)) >> 6].fetch_and(~bit, std::memory_order_acq_rel);
+				if (!(old & bit))
+					return;
+
+				//the slot cannot be handed out again before it is in a free list
+				c->entries[index & (ChunkSize - 1)] = T();
+				FreeList& list = freeLists[threadStripe()];
+				std::lock_guard<std::mutex> lock(list.mutex);
+				list.slots.push_back(index);
+				list.available.store(list.slots.size(), std::memory_order_relaxed);
+			}
+
+			T& operator[](size_t index) { return chunk(index)->entries[index & (ChunkSize - 1)]; }
+			const T& operator[](size_t index) const { return chunk(index)->entries[index & (ChunkSize - 1)]; }
+
+			bool isDeleted(size_t index) const
+			{
+				if (index >= sizeWithGaps())
+					return true;
+				Chunk* c = chunks[index >> ChunkBits].load(std::memory_order_acquire);
+				return c == nullptr
+					|| !((c->occupied[(index & (ChunkSize - 1)) >> 6].load(std::memory_order_acquire) >> (index & 63)) & 1);
+			}
+
+			size_t sizeWithGaps() const { return _size.load(); }
+
+			//Not thread-safe.
+			size_t sizeNotDeleted() const
+			{
+				size_t deleted = 0;
+				for (auto& list : freeLists)
+					deleted += list.slots.size();
+				return sizeWithGaps() - deleted;
+			}
+
+			//Calls f(index, entry) for all entries that are not deleted in the order of their indices. Not thread-safe.
+			template <typename Func>
+			void forEach(const Func& f)
+			{
+				size_t size = sizeWithGaps();
+				for (size_t c = 0; c * ChunkSize < size; ++c)
+				{
+					Chunk* chunk = chunks[c].load(std::memory_order_acquire);
+					for (size_t w = 0; w < ChunkSize / 64; ++w)
+					{
+						uint64_t word = chunk->occupied[w].load(std::memory_order_relaxed);
+						while (word != 0)
+						{
+							size_t i = w * 64 + countTrailingZeros(word);
+							f(c * ChunkSize + i, chunk->entries[i]);
+							word &= word - 1;
+						}
+					}
+				}
+			}
+
+			//Erases all entries. Chunks are kept for reuse. Not thread-safe.
+			void clear()
+			{
+				for (size_t c = 0; c < maxChunks; ++c)
+				{
+					Chunk* chunk = chunks[c].load(std::memory_order_relaxed);
+					if (chunk == nullptr)
+						continue;
+					for (size_t i = 0; i < ChunkSize; ++i)
+						chunk->entries[i] = T();
+					for (auto& word : chunk->occupied)
+						word.store(0, std::memory_order_relaxed);
+				}
+				for (auto& list : freeLists)
+				{
+					list.slots.clear();
+					list.available.store(0, std::memory_order_relaxed);
+				}
+				_size = 0;
+			}
+
+			//Not thread-safe.
+			template <typename Sink>
+			void saveToFile(Sink& f) const
+			{
+				size_t size = sizeWithGaps();
+				nse::data::saveToFile(size, f);
+				for (size_t c = 0; c * ChunkSize < size; ++c)
+					saveArrayToFile(chunks[c].load()->entries, std::min(ChunkSize, size - c * ChunkSize), f);
+
+				std::vector<Interval> emptySlots;
+				size_t deleted = 0;
+				for (size_t i = 0; i < size; ++i)
+				{
+					if (!isDeleted(i))
+						continue;
+					if (!emptySlots.empty() && emptySlots.back().upperExclusive == i)
+						++emptySlots.back().upperExclusive;
+					else
+						emptySlots.emplace_back(i, i + 1);
+					++deleted;
+				}
+				nse::data::saveToFile(emptySlots, f);
+				nse::data::saveToFile(deleted, f);
+			}
+
+			//Not thread-safe.
+			template <typename Source>
+			void loadFromFile(Source& f)
+			{
+				clear();
+				size_t size = loadSizeFromFile(f);
+				if (size > maxChunks * ChunkSize)
+					throw std::runtime_error("The capacity of the ConcurrentPersistentIndexContainer is exhausted.");
+				for (size_t c = 0; c * ChunkSize < size; ++c)
+				{
+					ensureChunk(c);
+					Chunk* chunk = chunks[c].load();
+					size_t n = std::min(ChunkSize, size - c * ChunkSize);
+					loadArrayFromFile(chunk->entries, n, f);
+					for (size_t i = 0; i < n; ++i)
+						chunk->occupied[i >> 6].fetch_or(1ull << (i & 63), std::memory_order_relaxed);
+				}
+				_size = size;
+
+				std::vector<Interval> emptySlots;
+				size_t totalEmptySlots;
+				nse::data::loadFromFile(emptySlots, f);
+				nse::data::loadFromFile(totalEmptySlots, f);
+				for (auto& interval : emptySlots)
+					for (size_t i = interval.lowerInclusive; i < interval.upperExclusive; ++i)
+					{
+						chunk(i)->occupied[(i & (ChunkSize - 1)) >> 6].fetch_and(~(1ull << (i & 63)), std::memory_order_relaxed);
+						freeLists[(i >> 6) % StripeCount].slots.push_back(i);
+					}
+				for (auto& list : freeLists)
+					list.available.store(list.slots.size(), std::memory_order_relaxed);
+			}
+
+		private:
+			struct Chunk
+			{
+				T* entries;
+				std::atomic<uint64_t> occupied[ChunkSize / 64];
+			};
+
+			//Aligned to a cache line such that threads that use different lists do not interfere.
+			struct alignas(64) FreeList
+			{
+				FreeList() : available(0) { }
+
+				std::mutex mutex;
+				std::vector<size_t> slots;
+				//number of slots, can be read without the lock
+				std::atomic<size_t> available;
+			};
+
+			static size_t threadStripe()
+			{
+				static thread_local size_t stripe = std::hash<std::thread::id>()(std::this_thread::get_id()) % StripeCount;
+				return stripe;
+			}
+
+			bool takeFreeSlot(size_t& index)
+			{
+				size_t stripe = threadStripe();
+				for (size_t i = 0; i < StripeCount; ++i)
+				{
+					FreeList& list = freeLists[(stripe + i) % StripeCount];
+					if (list.available.load(std::memory_order_relaxed) == 0)
+						continue;
+					std::lock_guard<std::mutex> lock(list.mutex);
+					if (list.slots.empty())
+						continue;
+					index = list.slots.back();
+					list.slots.pop_back();
+					list.available.store(list.slots.size(), std::memory_order_relaxed);
+					return true;
+				}
+				return false;
+			}
+
+			Chunk* chunk(size_t index) const { return chunks[index >> ChunkBits].load(std::memory_order_acquire); }
+
+			//Allocates the chunk if it does not exist. Concurrent callers race to publish their chunk.
+			void ensureChunk(size_t c)
+			{
+				if (chunks[c].load(std::memory_order_acquire) != nullptr)
+					return;
+				Chunk* chunk = createChunk();
+				Chunk* expected = nullptr;
+				if (!chunks[c].compare_exchange_strong(expected, chunk, std::memory_order_acq_rel))
+					destroyChunk(chunk);
+			}
+
+			Chunk* createChunk()
+			{
+				std::unique_ptr<Chunk> chunk(new Chunk());
+				for (auto& word : chunk->occupied)
+					word.store(0, std::memory_order_relaxed);
+				chunk->entries = AllocatorTraits::allocate(allocator, ChunkSize);
+				size_t constructed = 0;
+				try
+				{
+					for (; constructed < ChunkSize; ++constructed)
+						AllocatorTraits::construct(allocator, chunk->entries + constructed);
+				}
+				catch (...)
+				{
+					while (constructed > 0)
+						AllocatorTraits::destroy(allocator, chunk->entries + --constructed);
+					AllocatorTraits::deallocate(allocator, chunk->entries, ChunkSize);
+					throw;
+				}
+				return chunk.release();
+			}
+
+			void destroyChunk(Chunk* chunk)
+			{
+				for (size_t i = 0; i < ChunkSize; ++i)
+					AllocatorTraits::destroy(allocator, chunk->entries + i);
+				AllocatorTraits::deallocate(allocator, chunk->entries, ChunkSize);
+				delete chunk;
+			}
+
+			Allocator allocator;
+			size_t maxChunks;
+			std::unique_ptr<std::atomic<Chunk*>[]> chunks;
+			std::atomic<size_t> _size; //number of slots that have been handed out
+			FreeList freeLists[StripeCount];
+		};
+
+		template <typename T, typename Allocator, size_t ChunkBits>
+		const size_t ConcurrentPersistentIndexContainer<T, Allocator, ChunkBits>::ChunkSize;
+		template <typename T, typename Allocator, size_t ChunkBits>
+		const size_t ConcurrentPersistentIndexContainer<T, Allocator, ChunkBits>::StripeCount;
+
+		template <typename T, typename Allocator, size_t ChunkBits, typename Sink>
+		void saveToFile(const ConcurrentPersistentIndexContainer<T, Allocator, ChunkBits>& object, Sink& f) { object.saveToFile(f); }
+		template <typename T, typename Allocator, size_t ChunkBits, typename Source>
+		void loadFromFile(ConcurrentPersistentIndexContainer<T, Allocator, ChunkBits>& object, Source& f) { object.loadFromFile(f); }
+	}
+}
@@ -0,0 +1,120 @@
+/*
+	This file is part of NSEssentials.
+
+	Use of this source code is granted via a BSD-style license, which can be found
+	in License.txt in the repository root.
+
+	@author Nico Schertler
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <future>
+#include <cstdint>
+
+#include "nsessentials/NSELibrary.h"
+
+namespace nse {
+	namespace data
+	{
+		namespace detail
+		{
+			class TransferThreads;
+		}
+
+		struct DirectIOOptions
+		{
+			//Alignment of buffers, file offsets and transfer sizes. Must be a multiple of the
+			//logical block size of the device.
+			size_t alignment = 4096;
+
+			//Size of a single transfer. Rounded up to a multiple of the alignment.
+			size_t bufferSize = 8 * 1024 * 1024;
+
+			//Number of buffers. Up to queueDepth - 1 transfers are executed by as many threads that
+			//are created with the sink or source; with a single buffer, transfers are synchronous.
+			unsigned int queueDepth = 4;
+		};
+
+		//Sink that writes a file with direct I/O (O_DIRECT, F_NOCACHE, or FILE_FLAG_NO_BUFFERING) such
+		//that large checkpoints do not evict the page cache of other processes. Data is copied into
+		//aligned staging buffers that are written asynchronously. The unaligned tail of the file is
+		//written with buffered I/O on close. If the file system does not support direct I/O, the sink
+		//falls back to buffered I/O.
+		class NSE_EXPORT DirectFileSink
+		{
+		public:
+			DirectFileSink(const std::string& path, const DirectIOOptions& options = DirectIOOptions());
+			//Calls close() if it has not been called. Errors are only reported on stderr, so call close()
+			//explicitly to handle them.
+			~DirectFileSink();
+
+			DirectFileSink(const DirectFileSink&) = delete;
+			DirectFileSink& operator=(const DirectFileSink&) = delete;
+
+			void write(const void* data, size_t bytes);
+
+			//Waits for all transfers, writes the tail, and closes the file.
+			void close();
+
+			//Returns if the page cache is bypassed.
+			bool isDirect() const { return direct; }
+
+			uint64_t position() const { return offset + filled; }
+
+		private:
+			void submit(size_t bytes);
+			void waitForAll();
+
+			std::string path;
+			DirectIOOptions options;
+			int fd;
+			bool direct;
+
+			std::vector<std::shared_ptr<char>> buffers;
+			std::vector<std::future<void>> pending;
+			size_t current;
+			size_t filled;
+			//file offset of the current buffer
+			uint64_t offset;
+			//declared last so that the threads are joined before the other members are destroyed
+			std::unique_ptr<detail::TransferThreads> threads;
+		};
+
+		//Source that reads a file with direct I/O. The following transfers are prefetched asynchronously.
+		class NSE_EXPORT DirectFileSource
+		{
+		public:
+			DirectFileSource(const std::string& path, const DirectIOOptions& options = DirectIOOptions());
+			~DirectFileSource();
+
+			DirectFileSource(const DirectFileSource&) = delete;
+			DirectFileSource& operator=(const DirectFileSource&) = delete;
+
+			void read(void* data, size_t bytes);
+
+			bool isDirect() const { return direct; }
+
+		private:
+			void prefetch(size_t buffer);
+
+			DirectIOOptions options;
+			int fd;
+			bool direct;
+
+			std::vector<std::shared_ptr<char>> buffers;
+			std::vector<std::future<size_t>> pending;
+			size_t current;
+			bool hasBuffer;
+			//valid range of the current buffer
+			size_t begin, end;
+			//file offset of the next prefetch
+			uint64_t prefetchOffset;
+			bool endOfFile;
+			std::unique_ptr<detail::TransferThreads> threads;
+		};
+	}
+}
@@ -0,0 +1,149 @@
+/*
+	This file is part of NSEssentials.
+
+	Use of this source code is granted via a BSD-style license, which can be found
+	in License.txt in the repository root.
+
+	@author Nico Schertler
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+
+namespace nse {
+	namespace data
+	{
+		//Calculates a fast non-cryptographic 64-bit hash of a memory block. Hashes of consecutive
+		//blocks can be chained by passing the previous result as seed. The result is only
+		//identical to hashing the concatenation if all but the last block have a multiple of 8 bytes.
+		inline uint64_t hashBytes(const void* data, size_t bytes, uint64_t seed = 0xcbf29ce484222325ull)
+		{
+			const uint64_t prime = 0x100000001b3ull;
+			const unsigned char* p = static_cast<const unsigned char*>(data);
+			uint64_t h = seed;
+			for (; bytes >= 8; bytes -= 8, p += 8)
+			{
+				uint64_t word;
+				std::memcpy(&word, p, 8);
+				h = (h ^ word) * prime;
+				h ^= h >> 29;
+			}
+			for (; bytes > 0; --bytes, ++p)
+				h = (h ^ *p) * prime;
+			return h;
+		}
+
+		struct Hash128
+		{
+			uint64_t low, high;
+
+			bool operator==(const Hash128& other) const { return low == other.low && high == other.high; }
+			bool operator!=(const Hash128& other) const { return !(*this == other); }
+		};
+
+		namespace detail
+		{
+			inline uint64_t rotateLeft(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+			inline uint64_t finalMix(uint64_t k)
+			{
+				k ^= k >> 33;
+				k *= 0xff51afd7ed558ccdull;
+				k ^= k >> 33;
+				k *= 0xc4ceb9fe1a85ec53ull;
+				k ^= k >> 33;
+				return k;
+			}
+		}
+
+		//Calculates a 128-bit hash of a memory block (MurmurHash3_x64_128). It is slower than hashBytes() but
+		//mixes every input word into both halves, so it can be used to detect changed data where a
+		//collision of hashBytes() would go unnoticed.
+		inline Hash128 hashBytes128(const void* data, size_t bytes, uint64_t seed = 0)
+		{
+			const uint64_t c1 = 0x87c37b91114253d5ull;
+			const uint64_t c2 = 0x4cf5ad432745937full;
+			const unsigned char* p = static_cast<const unsigned char*>(data);
+			const size_t length = bytes;
+			uint64_t h1 = seed, h2 = seed;
+			for (; bytes >= 16; bytes -= 16, p += 16)
+			{
+				uint64_t k1, k2;
+				std::memcpy(&k1, p, 8);
+				std::memcpy(&k2, p + 8, 8);
+
+				k1 *= c1; k1 = detail::rotateLeft(k1, 31); k1 *= c2; h1 ^= k1;
+				h1 = detail::rotateLeft(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+				k2 *= c2; k2 = detail::rotateLeft(k2, 33); k2 *= c1; h2 ^= k2;
+				h2 = detail::rotateLeft(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+			}
+
+			//remaining bytes in little-endian order
+			uint64_t k1 = 0, k2 = 0;
+			for (size_t i = bytes; i > 8; --i)
+				k2 = (k2 << 8) | p[i - 1];
+			for (size_t i = bytes < 8 ? bytes : 8; i > 0; --i)
+				k1 = (k1 << 8) | p[i - 1];
+			if (bytes > 8)
+			{
+				k2 *= c2; k2 = detail::rotateLeft(k2, 33); k2 *= c1; h2 ^= k2;
+			}
+			if (bytes > 0)
+			{
+				k1 *= c1; k1 = detail::rotateLeft(k1, 31); k1 *= c2; h1 ^= k1;
+			}
+
+			h1 ^= length;
+			h2 ^= length;
+			h1 += h2;
+			h2 += h1;
+			h1 = detail::finalMix(h1);
+			h2 = detail::finalMix(h2);
+			h1 += h2;
+			h2 += h1;
+			return Hash128 { h1, h2 };
+		}
+
+		//Calculates hashBytes() of a byte stream that is passed in blocks of arbitrary size.
+		class IncrementalHash
+		{
+		public:
+			IncrementalHash()
+				: hash(hashBytes(nullptr, 0)), pendingBytes(0)
+			{ }
+
+			void update(const void* data, size_t bytes)
+			{
+				const unsigned char* p = static_cast<const unsigned char*>(data);
+				if (pendingBytes > 0)
+				{
+					size_t n = bytes < 8 - pendingBytes ? bytes : 8 - pendingBytes;
+					std::memcpy(pending + pendingBytes, p, n);
+					pendingBytes += n;
+					p += n;
+					bytes -= n;
+					if (pendingBytes < 8)
+						return;
+					hash = hashBytes(pending, 8, hash);
+					pendingBytes = 0;
+				}
+				size_t words = bytes & ~(size_t)7;
+				hash = hashBytes(p, words, hash);
+				if (bytes > words)
+					std::memcpy(pending, p + words, bytes - words);
+				pendingBytes = bytes - words;
+			}
+
+			//Returns the hash of all bytes so far.
+			uint64_t value() const { return hashBytes(pending, pendingBytes, hash); }
+
+		private:
+			uint64_t hash;
+			unsigned char pending[8]; //bytes that do not fill a word yet
+			size_t pendingBytes;
+		};
+	}
+}
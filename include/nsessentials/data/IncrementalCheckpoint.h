@@ -0,0 +1,126 @@
+/*
+	This file is part of NSEssentials.
+
+	Use of this source code is granted via a BSD-style license, which can be found
+	in License.txt in the repository root.
+
+	@author Nico Schertler
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "nsessentials/data/Serialization.h"
+#include "nsessentials/data/Streams.h"
+#include "nsessentials/data/MappedFile.h"
+#include "nsessentials/data/Hash.h"
+#include "nsessentials/NSELibrary.h"
+
+namespace nse {
+	namespace data
+	{
+		template <>
+		struct is_bulk_serializable<Hash128> : std::true_type
+		{ };
+
+		//Incremental checkpoints store the serialized state of a set of objects as a chain of files:
+		//  <path>              manifest: the first (base) and the last generation of the chain
+		//  <path>.<generation> the hashes of all chunks of the payload and the content of all chunks
+		//                      that changed with respect to the previous generation
+		//The base generation contains all chunks. Loading starts with the base and applies all
+		//following generations. Chunks are compared via 128-bit hashes (see hashBytes128()), which makes
+		//an unnoticed change of a chunk practically impossible.
+		struct IncrementalCheckpointOptions
+		{
+			//Size of the chunks that are compared between checkpoints.
+			uint64_t chunkSize = 1 << 20;
+
+			//Maximum number of delta generations after the base. If exceeded, the next checkpoint
+			//is written as a new base and the old chain is removed (compaction).
+			unsigned int maxChainLength = 16;
+
+			//Maximum number of threads for hashing (0 = hardware concurrency)
+			unsigned int threads = 0;
+		};
+
+		struct IncrementalCheckpointStats
+		{
+			uint64_t generation = 0;
+			uint64_t payloadBytes = 0;
+			//Number of payload bytes written to the generation file
+			uint64_t writtenBytes = 0;
+			uint64_t totalChunks = 0;
+			uint64_t dirtyChunks = 0;
+			//If this checkpoint has been written as a new base
+			bool isBase = false;
+		};
+
+		class NSE_EXPORT IncrementalCheckpointWriter
+		{
+		public:
+			//Continues an existing chain at the given path or starts a new one.
+			IncrementalCheckpointWriter(const std::string& path, const IncrementalCheckpointOptions& options = IncrementalCheckpointOptions());
+
+			IncrementalCheckpointWriter(const IncrementalCheckpointWriter&) = delete;
+			IncrementalCheckpointWriter& operator=(const IncrementalCheckpointWriter&) = delete;
+
+			//Serializes all objects with saveToFile() and writes the changed chunks as a new generation.
+			template <typename... T>
+			IncrementalCheckpointStats save(const T&... objects)
+			{
+				payload.clear();
+				saveAll(payload, objects...);
+				return commit(payload.data(), payload.size());
+			}
+
+			//Writes a new generation for an already serialized payload.
+			IncrementalCheckpointStats commit(const void* data, size_t bytes);
+
+			//Writes the next checkpoint as a new base and removes the previous chain.
+			void compact() { forceBase = true; }
+
+			//Generation of the last checkpoint (0 if there is none)
+			uint64_t generation() const { return lastGeneration; }
+
+		private:
+			template <typename Sink>
+			static void saveAll(Sink&) { }
+
+			template <typename Sink, typename First, typename... Rest>
+			static void saveAll(Sink& f, const First& first, const Rest&... rest)
+			{
+				saveToFile(first, f); //unqualified to find overloads via ADL
+				saveAll(f, rest...);
+			}
+
+			std::string path;
+			IncrementalCheckpointOptions options;
+			MemorySink payload;
+
+			uint64_t baseGeneration, lastGeneration;
+			//State of the last checkpoint
+			uint64_t lastPayloadBytes;
+			std::vector<Hash128> chunkHashes;
+			bool forceBase;
+		};
+
+		//Reassembles the payload of the latest generation of the chain at the given path.
+		NSE_EXPORT void loadCheckpointPayload(const std::string& path, std::vector<char>& payload);
+
+		//Loads the objects in the same order as they have been passed to IncrementalCheckpointWriter::save().
+		template <typename... T>
+		void loadCheckpoint(const std::string& path, T&... objects)
+		{
+			std::vector<char> payload;
+			loadCheckpointPayload(path, payload);
+			MappedReader reader(payload.data(), payload.size());
+			int expand[] = { 0, (loadFromFile(objects, reader), 0)... };
+			(void)expand;
+			if (reader.remaining() != 0)
+				throw std::runtime_error("The checkpoint has not been read completely.");
+		}
+	}
+}
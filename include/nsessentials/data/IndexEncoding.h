@@ -0,0 +1,379 @@
+/*
+	This file is part of NSEssentials.
+
+	Use of this source code is granted via a BSD-style license, which can be found
+	in License.txt in the repository root.
+
+	@author Nico Schertler
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <stdexcept>
+#include <type_traits>
+#include <algorithm>
+
+#include "nsessentials/data/Serialization.h"
+
+#if defined(__clang__)
+#define NSE_UNROLL_LOOP _Pragma("unroll")
+#elif defined(__GNUC__)
+#define NSE_UNROLL_LOOP _Pragma("GCC unroll 64")
+#else
+#define NSE_UNROLL_LOOP
+#endif
+
+//Compact encodings for integer arrays with small values or small differences, e.g. sorted indices.
+//Both encodings are opt-in per field. Usage:
+//  saveToFile(deltaVarint(indices), f);   loadFromFile(deltaVarint(indices), f);
+//  saveToFile(bitPacked(mortonCodes), f); loadFromFile(bitPacked(mortonCodes), f);
+//Delta + zig-zag varint gives the smallest files for sorted data. Frame-of-reference bit packing
+//stores blocks of 128 values with the minimum number of bits per block and decodes faster.
+
+namespace nse {
+	namespace data
+	{
+		inline uint64_t zigZagEncode(uint64_t delta) { return (delta << 1) ^ (uint64_t)((int64_t)delta >> 63); }
+		inline uint64_t zigZagDecode(uint64_t value) { return (value >> 1) ^ (0 - (value & 1)); }
+
+		//Converts an integer to 64 bits such that differences are preserved modulo 2^64.
+		template <typename T>
+		uint64_t toEncodingWord(T value) { return (uint64_t)(typename std::conditional<std::is_signed<T>::value, int64_t, uint64_t>::type)value; }
+
+		//Appends the zig-zag varint encoding of the differences between consecutive values to out.
+		template <typename T>
+		void encodeDeltaVarint(const T* data, size_t n, std::vector<char>& out)
+		{
+			static_assert(std::is_integral<T>::value, "Only integer arrays can be encoded.");
+			size_t offset = out.size();
+			out.resize(offset + n * 10);
+			unsigned char* p = reinterpret_cast<unsigned char*>(out.data() + offset);
+			uint64_t previous = 0;
+			for (size_t i = 0; i < n; ++i)
+			{
+				uint64_t value = toEncodingWord(data[i]);
+				uint64_t v = zigZagEncode(value - previous);
+				previous = value;
+				while (v >= 0x80)
+				{
+					*p++ = (unsigned char)(v | 0x80);
+					v >>= 7;
+				}
+				*p++ = (unsigned char)v;
+			}
+			out.resize(p - reinterpret_cast<unsigned char*>(out.data()));
+		}
+
+		//Decodes n values that have been encoded with encodeDeltaVarint(). Returns the number of bytes read.
+		template <typename T>
+		size_t decodeDeltaVarint(const char* encoded, size_t bytes, T* data, size_t n)
+		{
+			const unsigned char* p = reinterpret_cast<const unsigned char*>(encoded);
+			const unsigned char* end = p + bytes;
+			uint64_t previous = 0;
+			for (size_t i = 0; i < n; ++i)
+			{
+				uint64_t v;
+				if (end - p >= 10)
+				{
+					//fast path without bounds checks, reads at most 10 bytes
+					v = *p & 0x7f;
+					int shift = 7;
+					while ((*p++ & 0x80) && shift < 64)
+					{
+						v |= (uint64_t)(*p & 0x7f) << shift;
+						shift += 7;
+					}
+				}
+				else
+				{
+					v = 0;
+					int shift = 0;
+					while (true)
+					{
+						if (p == end || shift > 63)
+							throw std::runtime_error("The delta-encoded data is corrupt.");
+						unsigned char b = *p++;
+						v |= (uint64_t)(b & 0x7f) << shift;
+						shift += 7;
+						if (!(b & 0x80))
+							break;
+					}
+				}
+				previous += zigZagDecode(v);
+				data[i] = (T)previous;
+			}
+			return p - reinterpret_cast<const unsigned char*>(encoded);
+		}
+
+		const size_t BitPackingBlockSize = 128;
+
+		//Unpacks a block of 128 values with the given number of bits. Every half block consists of Bits
+		//words. With a compile-time width and an unrolled loop, all word indices and shifts are constants.
+		template <int Bits>
+		void unpackBitBlock(const uint64_t* in, uint64_t* out)
+		{
+			const uint64_t mask = Bits == 64 ? ~0ull : (1ull << (Bits & 63)) - 1;
+			for (int half = 0; half < 2; ++half, in += Bits, out += 64)
+			{
+				NSE_UNROLL_LOOP
+				for (int i = 0; i < 64; ++i)
+				{
+					const int bit = i * Bits;
+					const int shift = bit & 63;
+					uint64_t v = in[bit >> 6] >> shift;
+					if (shift + Bits > 64)
+						v |= in[(bit >> 6) + 1] << ((64 - shift) & 63);
+					out[i] = v & mask;
+				}
+			}
+		}
+
+		typedef void(*UnpackBitBlockFunction)(const uint64_t*, uint64_t*);
+
+		template <int Bits>
+		struct UnpackBitBlockTable
+		{
+			static void fill(UnpackBitBlockFunction* table)
+			{
+				table[Bits] = &unpackBitBlock<Bits>;
+				UnpackBitBlockTable<Bits - 1>::fill(table);
+			}
+		};
+
+		template <>
+		struct UnpackBitBlockTable<-1>
+		{
+			static void fill(UnpackBitBlockFunction*) { }
+		};
+
+		inline const UnpackBitBlockFunction* unpackBitBlockFunctions()
+		{
+			struct Table
+			{
+				Table() { UnpackBitBlockTable<64>::fill(functions); }
+				UnpackBitBlockFunction functions[65];
+			};
+			static const Table table;
+			return table.functions;
+		}
+
+		//Appends the frame-of-reference encoding of the values to out. Every block of 128 values is stored as
+		//  reference (uint64), bit width w (uint8), 2 * w 64-bit words with the values minus the reference
+		//If delta is true, the zig-zag encoded differences of consecutive values are packed instead.
+		template <typename T>
+		void encodeBitPacked(const T* data, size_t n, std::vector<char>& out, bool delta)
+		{
+			static_assert(std::is_integral<T>::value, "Only integer arrays can be encoded.");
+			uint64_t values[BitPackingBlockSize];
+			uint64_t words[2 * 64];
+			uint64_t previous = 0;
+			for (size_t blockStart = 0; blockStart < n; blockStart += BitPackingBlockSize)
+			{
+				size_t count = std::min(BitPackingBlockSize, n - blockStart);
+				for (size_t i = 0; i < count; ++i)
+				{
+					uint64_t value = toEncodingWord(data[blockStart + i]);
+					values[i] = delta ? zigZagEncode(value - previous) : value;
+					previous = value;
+				}
+				uint64_t reference = *std::min_element(values, values + count);
+				uint64_t range = 0;
+				for (size_t i = 0; i < count; ++i)
+				{
+					values[i] -= reference;
+					range |= values[i];
+				}
+				std::fill(values + count, values + BitPackingBlockSize, 0);
+				uint8_t bits = 0;
+				while (bits < 64 && (range >> bits) != 0)
+					++bits;
+
+				size_t wordCount = 2 * bits;
+				std::fill(words, words + wordCount, 0);
+				for (size_t i = 0; i < BitPackingBlockSize && bits > 0; ++i)
+				{
+					size_t bit = i * bits;
+					size_t word = bit >> 6;
+					size_t shift = bit & 63;
+					words[word] |= values[i] << shift;
+					if (shift + bits > 64)
+						words[word + 1] |= values[i] >> (64 - shift);
+				}
+
+				size_t offset = out.size();
+				out.resize(offset + sizeof(uint64_t) + 1 + wordCount * sizeof(uint64_t));
+				std::memcpy(out.data() + offset, &reference, sizeof(uint64_t));
+				out[offset + sizeof(uint64_t)] = (char)bits;
+				std::memcpy(out.data() + offset + sizeof(uint64_t) + 1, words, wordCount * sizeof(uint64_t));
+			}
+		}
+
+		//Decodes n values that have been encoded with encodeBitPacked(). Returns the number of bytes read.
+		template <typename T>
+		size_t decodeBitPacked(const char* encoded, size_t bytes, T* data, size_t n, bool delta)
+		{
+			const UnpackBitBlockFunction* unpack = unpackBitBlockFunctions();
+			uint64_t values[BitPackingBlockSize];
+			uint64_t words[2 * 64];
+			uint64_t previous = 0;
+			size_t offset = 0;
+			for (size_t blockStart = 0; blockStart < n; blockStart += BitPackingBlockSize)
+			{
+				uint64_t reference;
+				if (bytes - offset < sizeof(uint64_t) + 1)
+					throw std::runtime_error("The bit-packed data is corrupt.");
+				std::memcpy(&reference, encoded + offset, sizeof(uint64_t));
+				unsigned int bits = (unsigned char)encoded[offset + sizeof(uint64_t)];
+				offset += sizeof(uint64_t) + 1;
+				size_t wordBytes = 2 * bits * sizeof(uint64_t);
+				if (bits > 64 || bytes - offset < wordBytes)
+					throw std::runtime_error("The bit-packed data is corrupt.");
+				std::memcpy(words, encoded + offset, wordBytes);
+				offset += wordBytes;
+
+				unpack[bits](words, values);
+				size_t count = std::min(BitPackingBlockSize, n - blockStart);
+				T* out = data + blockStart;
+				if (delta)
+					for (size_t i = 0; i < count; ++i)
+					{
+						previous += zigZagDecode(values[i] + reference);
+						out[i] = (T)previous;
+					}
+				else
+					for (size_t i = 0; i < count; ++i)
+						out[i] = (T)(values[i] + reference);
+			}
+			return offset;
+		}
+
+		//Writes and reads encoded arrays as: number of values (uint64), encoded data (std::vector<char>)
+		template <typename T, typename Sink>
+		void saveDeltaVarintArrayToFile(const T* data, size_t n, Sink& f)
+		{
+			std::vector<char> buffer;
+			encodeDeltaVarint(data, n, buffer);
+			uint64_t count = n;
+			saveToFile(count, f);
+			saveToFile(buffer, f);
+		}
+
+		template <typename T, typename Source>
+		void loadDeltaVarintArrayFromFile(T* data, size_t n, Source& f)
+		{
+			uint64_t count;
+			loadFromFile(count, f);
+			if (count != n)
+				throw std::runtime_error("The encoded array does not have the expected size.");
+			std::vector<char> buffer;
+			loadFromFile(buffer, f);
+			if (decodeDeltaVarint(buffer.data(), buffer.size(), data, n) != buffer.size())
+				throw std::runtime_error("The delta-encoded data is corrupt.");
+		}
+
+		template <typename T, typename Sink>
+		void saveBitPackedArrayToFile(const T* data, size_t n, Sink& f, bool delta = false)
+		{
+			std::vector<char> buffer;
+			encodeBitPacked(data, n, buffer, delta);
+			uint64_t count = n;
+			uint8_t deltaFlag = delta ? 1 : 0;
+			saveToFile(count, f);
+			saveToFile(deltaFlag, f);
+			saveToFile(buffer, f);
+		}
+
+		template <typename T, typename Source>
+		void loadBitPackedArrayFromFile(T* data, size_t n, Source& f)
+		{
+			uint64_t count;
+			uint8_t deltaFlag;
+			loadFromFile(count, f);
+			loadFromFile(deltaFlag, f);
+			if (count != n)
+				throw std::runtime_error("The encoded array does not have the expected size.");
+			std::vector<char> buffer;
+			loadFromFile(buffer, f);
+			if (decodeBitPacked(buffer.data(), buffer.size(), data, n, deltaFlag != 0) != buffer.size())
+				throw std::runtime_error("The bit-packed data is corrupt.");
+		}
+
+		//Wraps an integer vector such that it is delta + zig-zag varint encoded by saveToFile() and decoded by loadFromFile().
+		template <typename Container>
+		struct DeltaVarint
+		{
+			DeltaVarint(Container& container) : container(container) { }
+			Container& container;
+		};
+
+		template <typename Container>
+		DeltaVarint<Container> deltaVarint(Container& container) { return DeltaVarint<Container>(container); }
+
+		//Wraps an integer vector such that it is frame-of-reference bit packed by saveToFile() and unpacked by loadFromFile().
+		//If delta is true, the differences of consecutive values are packed, which suits sorted data.
+		template <typename Container>
+		struct BitPacked
+		{
+			BitPacked(Container& container, bool delta) : container(container), delta(delta) { }
+			Container& container;
+			bool delta;
+		};
+
+		template <typename Container>
+		BitPacked<Container> bitPacked(Container& container, bool delta = false) { return BitPacked<Container>(container, delta); }
+
+		template <typename T, typename Allocator, typename Sink>
+		void saveToFile(const DeltaVarint<std::vector<T, Allocator>>& object, Sink& f)
+		{
+			saveDeltaVarintArrayToFile(object.container.data(), object.container.size(), f);
+		}
+
+		template <typename T, typename Allocator, typename Sink>
+		void saveToFile(const DeltaVarint<const std::vector<T, Allocator>>& object, Sink& f)
+		{
+			saveDeltaVarintArrayToFile(object.container.data(), object.container.size(), f);
+		}
+
+		template <typename T, typename Allocator, typename Source>
+		void loadFromFile(DeltaVarint<std::vector<T, Allocator>> object, Source& f)
+		{
+			uint64_t count;
+			loadFromFile(count, f);
+			object.container.resize((size_t)count);
+			std::vector<char> buffer;
+			loadFromFile(buffer, f);
+			if (decodeDeltaVarint(buffer.data(), buffer.size(), object.container.data(), object.container.size()) != buffer.size())
+				throw std::runtime_error("The delta-encoded data is corrupt.");
+		}
+
+		template <typename T, typename Allocator, typename Sink>
+		void saveToFile(const BitPacked<std::vector<T, Allocator>>& object, Sink& f)
+		{
+			saveBitPackedArrayToFile(object.container.data(), object.container.size(), f, object.delta);
+		}
+
+		template <typename T, typename Allocator, typename Sink>
+		void saveToFile(const BitPacked<const std::vector<T, Allocator>>& object, Sink& f)
+		{
+			saveBitPackedArrayToFile(object.container.data(), object.container.size(), f, object.delta);
+		}
+
+		template <typename T, typename Allocator, typename Source>
+		void loadFromFile(BitPacked<std::vector<T, Allocator>> object, Source& f)
+		{
+			uint64_t count;
+			uint8_t deltaFlag;
+			loadFromFile(count, f);
+			loadFromFile(deltaFlag, f);
+			object.container.resize((size_t)count);
+			std::vector<char> buffer;
+			loadFromFile(buffer, f);
+			if (decodeBitPacked(buffer.data(), buffer.size(), object.container.data(), object.container.size(), deltaFlag != 0) != buffer.size())
+				throw std::runtime_error("The bit-packed data is corrupt.");
+		}
+	}
+}
@@ -0,0 +1,216 @@
+/*
+	This file is part of NSEssentials.
+
+	Use of this source code is granted via a BSD-style license, which can be found
+	in License.txt in the repository root.
+
+	@author Nico Schertler
+*/
+
+#pragma once
+
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+
+#ifdef HAVE_EIGEN
+#include <Eigen/Core>
+#include <Eigen/SparseCore>
+#endif
+
+#include "nsessentials/data/Serialization.h"
+#include "nsessentials/NSELibrary.h"
+
+namespace nse {
+	namespace data
+	{
+		//Read-only view of a contiguous array that is owned by someone else.
+		template <typename T>
+		class ArrayView
+		{
+		public:
+			typedef const T* iterator;
+
+			ArrayView()
+				: _data(nullptr), _size(0)
+			{ }
+
+			ArrayView(const T* data, size_t size)
+				: _data(data), _size(size)
+			{ }
+
+			const T* data() const { return _data; }
+			size_t size() const { return _size; }
+			bool empty() const { return _size == 0; }
+
+			const T& operator[](size_t i) const { return _data[i]; }
+
+			iterator begin() const { return _data; }
+			iterator end() const { return _data + _size; }
+
+		private:
+			const T* _data;
+			size_t _size;
+		};
+
+		//Read-only memory mapping of an entire file. Pages are loaded lazily on first access
+		//and are shared via the page cache with all other processes that map the same file.
+		class NSE_EXPORT MappedFile
+		{
+		public:
+			MappedFile();
+			MappedFile(const std::string& path);
+			MappedFile(MappedFile&& other);
+			MappedFile& operator=(MappedFile&& other);
+			~MappedFile();
+
+			MappedFile(const MappedFile&) = delete;
+			MappedFile& operator=(const MappedFile&) = delete;
+
+			//Maps the specified file. Any previously mapped file is unmapped.
+			void open(const std::string& path);
+			void close();
+
+			bool isOpen() const { return _data != nullptr; }
+
+			const char* data() const { return _data; }
+			size_t size() const { return _size; }
+
+		private:
+			const char* _data;
+			size_t _size;
+
+#ifdef _WIN32
+			void* fileHandle;
+			void* mappingHandle;
+#endif
+		};
+
+		//Reads data in the format of saveToFile() sequentially from a memory region. Arrays of
+		//bulk-serializable types are returned as views into the region without copying.
+		//All views are only valid as long as the underlying region is.
+		class MappedReader
+		{
+		public:
+			//If alignedArrays is true, the region has been written by a sink that aligns
+			//contiguous arrays (e.g., SharedMemoryWriter) and the padding is skipped.
+			MappedReader(const char* data, size_t size, bool alignedArrays = false)
+				: begin(data), current(data), end(data + size), alignedArrays(alignedArrays)
+			{ }
+
+			MappedReader(const MappedFile& file)
+				: MappedReader(file.data(), file.size())
+			{ }
+
+			//Copies raw bytes from the region. With this function, MappedReader is a Source for
+			//loadFromFile() (see Serialization.h).
+			void read(void* data, size_t bytes)
+			{
+				const char* p = advance(bytes);
+				if (bytes > 0)
+					std::memcpy(data, p, bytes);
+			}
+
+			//Copies a single bulk-serializable object from the region.
+			template <typename T>
+			void read(T& object)
+			{
+				static_assert(is_bulk_serializable<T>::value, "MappedReader can only copy bulk-serializable types.");
+				std::memcpy(&object, advance(sizeof(T)), sizeof(T));
+			}
+
+			template <typename T>
+			T read()
+			{
+				T object;
+				read(object);
+				return object;
+			}
+
+			//Returns a view of n consecutive objects.
+			template <typename T>
+			ArrayView<T> readArray(size_t n)
+			{
+				static_assert(is_bulk_serializable<T>::value, "MappedReader can only provide views of bulk-serializable types.");
+				align(alignof(T));
+				if (reinterpret_cast<uintptr_t>(current) % alignof(T) != 0)
+					throw std::runtime_error("The mapped data is not sufficiently aligned to be viewed in place.");
+				if (n > (size_t)(end - current) / sizeof(T))
+					throw std::runtime_error("Cannot read enough data from mapped region");
+				return ArrayView<T>(reinterpret_cast<const T*>(advance(n * sizeof(T))), n);
+			}
+
+			//Returns a view of a std::vector<T> that has been stored with saveToFile().
+			template <typename T>
+			ArrayView<T> readVector()
+			{
+				return readArray<T>(read<size_t>());
+			}
+
+#ifdef HAVE_EIGEN
+			//Returns a view of a dense Eigen matrix that has been stored with saveToFile().
+			//Coefficients are always stored in column-major order.
+			template <typename Scalar, int Rows = Eigen::Dynamic, int Cols = Eigen::Dynamic>
+			Eigen::Map<const Eigen::Matrix<Scalar, Rows, Cols>> readMatrix()
+			{
+				Eigen::Index rows = Rows, cols = Cols;
+				if (Rows == Eigen::Dynamic)
+					read(rows);
+				if (Cols == Eigen::Dynamic)
+					read(cols);
+				auto coefficients = readArray<Scalar>(rows * cols);
+				return Eigen::Map<const Eigen::Matrix<Scalar, Rows, Cols>>(coefficients.data(), rows, cols);
+			}
+
+			//Returns a view of a sparse Eigen matrix that has been stored with saveToFile().
+			template <typename Scalar, int Options = Eigen::ColMajor, typename StorageIndex = int>
+			Eigen::Map<const Eigen::SparseMatrix<Scalar, Options, StorageIndex>> readSparseMatrix()
+			{
+				Eigen::Index rows = (Eigen::Index)read<uint64_t>();
+				Eigen::Index cols = (Eigen::Index)read<uint64_t>();
+				size_t n = (size_t)read<uint64_t>();
+				Eigen::Index outerSize = (Options & Eigen::RowMajor) ? rows : cols;
+				auto outer = readArray<StorageIndex>(outerSize + 1);
+				skip(sparseArrayPadding((outerSize + 1) * sizeof(StorageIndex)));
+				auto inner = readArray<StorageIndex>(n);
+				skip(sparseArrayPadding(n * sizeof(StorageIndex)));
+				auto values = readArray<Scalar>(n);
+				skip(sparseArrayPadding(n * sizeof(Scalar)));
+				return Eigen::Map<const Eigen::SparseMatrix<Scalar, Options, StorageIndex>>(rows, cols, (Eigen::Index)n,
+					outer.data(), inner.data(), values.data());
+			}
+#endif
+
+			//Skips padding in front of an array if the region has aligned arrays.
+			void align(size_t alignment)
+			{
+				if (alignedArrays)
+					advance((alignment - position() % alignment) % alignment);
+			}
+
+			//Skips the specified number of bytes.
+			void skip(size_t bytes) { advance(bytes); }
+
+			//Returns the current offset from the beginning of the region.
+			size_t position() const { return current - begin; }
+			size_t remaining() const { return end - current; }
+
+		private:
+			const char* advance(size_t bytes)
+			{
+				if (bytes > (size_t)(end - current))
+					throw std::runtime_error("Cannot read enough data from mapped region");
+				const char* result = current;
+				current += bytes;
+				return result;
+			}
+
+			const char* begin;
+			const char* current;
+			const char* end;
+			bool alignedArrays;
+		};
+	}
+}
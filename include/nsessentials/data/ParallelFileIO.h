@@ -0,0 +1,101 @@
+/*
+	This file is part of NSEssentials.
+
+	Use of this source code is granted via a BSD-style license, which can be found
+	in License.txt in the repository root.
+
+	@author Nico Schertler
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "nsessentials/NSELibrary.h"
+
+namespace nse {
+	namespace data
+	{
+		struct ParallelIOOptions
+		{
+			//Writes and reads of at least this size are split into chunks that are processed in parallel.
+			size_t parallelThreshold = 16 * 1024 * 1024;
+
+			//Size of the chunks of a parallel transfer.
+			size_t chunkSize = 4 * 1024 * 1024;
+
+			//Size of the buffer for small transfers.
+			size_t bufferSize = 4 * 1024 * 1024;
+
+			//Maximum number of threads (0 = hardware concurrency)
+			unsigned int threads = 0;
+		};
+
+		//Sink that writes to a file with positioned writes (pwrite). Large payloads (vectors, Eigen
+		//matrices, UnionFind arrays) are split into chunks at precomputed file offsets and written
+		//by multiple threads. The resulting file is identical to the one of a sequential write.
+		class NSE_EXPORT ParallelFileSink
+		{
+		public:
+			ParallelFileSink(const std::string& path, const ParallelIOOptions& options = ParallelIOOptions());
+			//Calls close() if it has not been called. Errors are only reported on stderr, so call close()
+			//explicitly to handle them.
+			~ParallelFileSink();
+
+			ParallelFileSink(const ParallelFileSink&) = delete;
+			ParallelFileSink& operator=(const ParallelFileSink&) = delete;
+
+			void write(const void* data, size_t bytes);
+
+			//Writes the buffer to the file.
+			void flush();
+
+			//Writes the buffer and closes the file. Throws if any data could not be written or the file
+			//cannot be closed. The sink cannot be used afterwards.
+			void close();
+
+			uint64_t position() const { return offset + buffered; }
+
+		private:
+			int fd; //-1 after close()
+			ParallelIOOptions options;
+
+			//file offset of the buffer
+			uint64_t offset;
+			std::vector<char> buffer;
+			size_t buffered;
+		};
+
+		//Source that reads from a file with positioned reads (pread). Large payloads are split into
+		//chunks that are read by multiple threads.
+		class NSE_EXPORT ParallelFileSource
+		{
+		public:
+			ParallelFileSource(const std::string& path, const ParallelIOOptions& options = ParallelIOOptions());
+			~ParallelFileSource();
+
+			ParallelFileSource(const ParallelFileSource&) = delete;
+			ParallelFileSource& operator=(const ParallelFileSource&) = delete;
+
+			void read(void* data, size_t bytes);
+
+			uint64_t position() const { return offset - (bufferEnd - bufferBegin); }
+
+		private:
+			int fd;
+			ParallelIOOptions options;
+
+			//file offset of the end of the buffer
+			uint64_t offset;
+			std::vector<char> buffer;
+			size_t bufferBegin, bufferEnd;
+		};
+
+		//Positioned I/O that transfers all bytes unless an error occurs. Read returns the number
+		//of bytes read, which is smaller than bytes only at the end of the file.
+		NSE_EXPORT void positionedWrite(int fd, const void* data, size_t bytes, uint64_t offset);
+		NSE_EXPORT size_t positionedRead(int fd, void* data, size_t bytes, uint64_t offset);
+	}
+}
@@ -16,6 +16,11 @@
 #include <vector>
 #include <random>
 #include <atomic>
+#include <thread>
+#include <exception>
+#include <algorithm>
+#include <functional>
+#include <memory>
 
 #ifdef HAVE_TBB
 #include <tbb/tbb.h>
@@ -94,6 +99,83 @@ namespace nse {
 				;
 		}
 
+#ifndef HAVE_TBB
+		namespace detail
+		{
+			//Work that is shared between the calling thread and helper threads of the worker pool.
+			struct ParallelJob
+			{
+				ParallelJob() : closed(false), running(0) { }
+
+				std::function<void()> work;
+				std::mutex mutex;
+				std::condition_variable finished;
+				bool closed; //helpers that start after the job has been closed do nothing
+				size_t running; //number of helpers that are executing work
+			};
+
+			//Number of threads in the worker pool, which is created on first use and is shared by all
+			//calls of parallel_for_index().
+			NSE_EXPORT unsigned int workerPoolSize();
+
+			//Runs job->work on up to helpers threads of the worker pool.
+			NSE_EXPORT void submitParallelJob(const std::shared_ptr<ParallelJob>& job, size_t helpers);
+
+			//Prevents helpers that have not started yet from running the job and waits for the ones that
+			//are running. Helpers that are still queued (e.g., because all workers are busy with an outer
+			//parallel loop) are skipped, so nested calls cannot deadlock.
+			NSE_EXPORT void finishParallelJob(ParallelJob& job);
+		}
+#endif
+
+		//Calls f(i) for every i in [0, count) in parallel. Uses TBB if available and otherwise
+		//up to maxThreads threads (0 = hardware concurrency) of a worker pool that is shared by all
+		//calls, so no threads are created per call. The calling thread takes part in the work.
+		//Exceptions are passed to the caller.
+		template <typename Func>
+		void parallel_for_index(size_t count, const Func& f, unsigned int maxThreads = 0)
+		{
+#ifdef HAVE_TBB
+			tbb::parallel_for(size_t(0), count, [&](size_t i) { f(i); });
+#else
+			if (maxThreads == 0)
+				maxThreads = std::max(1u, std::thread::hardware_concurrency());
+			size_t threadCount = std::min<size_t>(std::min(maxThreads, detail::workerPoolSize() + 1), count);
+			if (threadCount <= 1)
+			{
+				for (size_t i = 0; i < count; ++i)
+					f(i);
+				return;
+			}
+
+			std::atomic<size_t> next(0);
+			std::exception_ptr error;
+			std::mutex errorMutex;
+			auto worker = [&]()
+			{
+				try
+				{
+					for (size_t i = next++; i < count; i = next++)
+						f(i);
+				}
+				catch (...)
+				{
+					std::lock_guard<std::mutex> lock(errorMutex);
+					if (!error)
+						error = std::current_exception();
+					next = count;
+				}
+			};
+			auto job = std::make_shared<detail::ParallelJob>();
+			job->work = worker;
+			detail::submitParallelJob(job, threadCount - 1);
+			worker();
+			detail::finishParallelJob(*job);
+			if (error)
+				std::rethrow_exception(error);
+#endif
+		}
+
 		class ordered_lock
 		{
 		public:
@@ -10,10 +10,19 @@
 #pragma once
 
 #include <vector>
-#include <deque>
 #include <algorithm>
+#include <iterator>
+#include <numeric>
+#include <cassert>
+#include <cstdint>
+#include <stdexcept>
 
 #include "nsessentials/data/Serialization.h"
+#include "nsessentials/data/Bitmap.h"
+#include "nsessentials/data/Parallelization.h"
+#include "nsessentials/data/ChunkedStorage.h"
+#include "nsessentials/data/RankSelectIndex.h"
+#include "nsessentials/NSELibrary.h"
 
 namespace nse {
 	namespace data
@@ -29,252 +38,814 @@ namespace nse {
 			size_t upperExclusive;
 		};
 
-		template <typename T, typename Allocator>
-		class EntryIterator;
+		template <>
+		struct is_bulk_serializable<Interval> : std::true_type
+		{ };
 
-		//Represents a container that allows add and remove while keeping indices persistent.
-		template <typename T, typename Allocator = std::allocator<T> >
-		class PersistentIndexContainer
+		//Reference to an entry of a PersistentIndexContainer that detects if the entry has been erased
+		//in the meantime (even if its slot has been reused). Packs the slot index (lower 40 bits) and the
+		//generation of the slot (upper 24 bits). The generation of a slot is incremented whenever its entry
+		//is erased and wraps around after 2^24 erasures.
+		struct PersistentIndexHandle
 		{
-		public:
+			static const int IndexBits = 40;
+			static const uint32_t GenerationMask = (1u << (64 - IndexBits)) - 1;
 
-			typedef EntryIterator<T, Allocator> iterator;
+			//Creates an invalid handle.
+			PersistentIndexHandle()
+				: value((uint64_t)-1)
+			{ }
 
-			PersistentIndexContainer()
-				: totalEmptySlots(0)
+			PersistentIndexHandle(size_t index, uint32_t generation)
+				: value(((uint64_t)generation << IndexBits) | (uint64_t)index)
 			{ }
 
-			size_t insert()
+			size_t index() const { return (size_t)(value & ((1ull << IndexBits) - 1)); }
+			uint32_t generation() const { return (uint32_t)(value >> IndexBits); }
+
+			bool operator==(const PersistentIndexHandle& other) const { return value == other.value; }
+			bool operator!=(const PersistentIndexHandle& other) const { return value != other.value; }
+
+			uint64_t value;
+		};
+
+		template <>
+		struct is_bulk_serializable<PersistentIndexHandle> : std::true_type
+		{ };
+
+		//Sorted set of disjoint slot intervals that records which entries have been modified, e.g., to update
+		//only those parts of a GPU buffer. Overlapping and adjacent intervals are merged. If there are more than
+		//maxRanges intervals, the two intervals with the smallest gap between them are merged, so the set may
+		//cover slots that have not been modified, but it never misses one. Adding an interval costs O(maxRanges)
+		//in the worst case and O(1) if it extends the last interval (e.g., when appending entries).
+		class DirtyRangeSet
+		{
+		public:
+			DirtyRangeSet(size_t maxRanges = 64)
+				: maxRanges(std::max<size_t>(1, maxRanges))
+			{ }
+
+			void setMaxRanges(size_t maxRanges)
 			{
-				if (!emptySlots.empty())
+				this->maxRanges = std::max<size_t>(1, maxRanges);
+				while (_ranges.size() > this->maxRanges)
+					mergeClosest();
+			}
+
+			void add(size_t index) { add(index, index + 1); }
+
+			//Adds the interval [begin, end).
+			void add(size_t begin, size_t end)
+			{
+				if (begin >= end)
+					return;
+				if (!_ranges.empty() && begin >= _ranges.back().lowerInclusive && begin <= _ranges.back().upperExclusive)
 				{
-					auto& emptySlot = emptySlots.front();
-					size_t slot = emptySlot.lowerInclusive;
-					++emptySlot.lowerInclusive;
-					if (emptySlot.lowerInclusive == emptySlot.upperExclusive)
-						emptySlots.pop_front();
-					--totalEmptySlots;
-					return slot;
+					_ranges.back().upperExclusive = std::max(_ranges.back().upperExclusive, end);
+					return;
 				}
+
+				//first interval that overlaps or touches [begin, end)
+				auto first = std::lower_bound(_ranges.begin(), _ranges.end(), begin,
+					[](const Interval& interval, size_t value) { return interval.upperExclusive < value; });
+				auto last = first;
+				while (last != _ranges.end() && last->lowerInclusive <= end)
+				{
+					begin = std::min(begin, last->lowerInclusive);
+					end = std::max(end, last->upperExclusive);
+					++last;
+				}
+				if (first == last)
+					_ranges.insert(first, Interval(begin, end));
 				else
 				{
-					data.emplace_back();
-					return data.size() - 1;
+					*first = Interval(begin, end);
+					_ranges.erase(first + 1, last);
 				}
+
+				if (_ranges.size() > maxRanges)
+					mergeClosest();
 			}
 
-			T& operator[](size_t index) { return data[index]; }
-			const T& operator[](size_t index) const { return data[index]; }
+			void clear() { _ranges.clear(); }
+			bool empty() const { return _ranges.empty(); }
 
-			void clear()
+			//Returns the number of slots that are covered by the intervals.
+			size_t coveredSlots() const
 			{
-				data.clear();
-				emptySlots.clear();
-				totalEmptySlots = 0;
+				size_t result = 0;
+				for (auto& interval : _ranges)
+					result += interval.upperExclusive - interval.lowerInclusive;
+				return result;
 			}
 
-			void reserve(size_t additionalElements)
+			const std::vector<Interval>& ranges() const { return _ranges; }
+			std::vector<Interval>::const_iterator begin() const { return _ranges.begin(); }
+			std::vector<Interval>::const_iterator end() const { return _ranges.end(); }
+
+		private:
+			void mergeClosest()
 			{
-				size_t moreSpaceNeeded = additionalElements - totalEmptySlots;
-				if (moreSpaceNeeded > 0)
-					data.reserve(data.size() + moreSpaceNeeded);
+				size_t best = 0;
+				for (size_t i = 1; i + 1 < _ranges.size(); ++i)
+					if (_ranges[i + 1].lowerInclusive - _ranges[i].upperExclusive < _ranges[best + 1].lowerInclusive - _ranges[best].upperExclusive)
+						best = i;
+				_ranges[best].upperExclusive = _ranges[best + 1].upperExclusive;
+				_ranges.erase(_ranges.begin() + best + 1);
 			}
 
-			size_t sizeWithGaps() const { return data.size(); }
-			size_t sizeNotDeleted() const { return data.size() - totalEmptySlots; }
+			std::vector<Interval> _ranges;
+			size_t maxRanges;
+		};
+
+		template <typename T, typename Allocator, typename Storage>
+		class EntryIterator;
+
+		template <typename T, typename Allocator, typename Storage>
+		class LiveEntryRange;
+
+		//Slot bookkeeping of PersistentIndexContainer and PersistentIndexSoA, which store their entries
+		//separately. Used slots are tracked in an occupancy bitmap (for constant-time liveness checks and
+		//iteration that skips 64 slots at a time) and deleted slots in a hierarchical bitmap (for finding
+		//the lowest deleted slot in O(log_64 n)). Both insert and erase run in O(log_64 n). Also maintains
+		//the generations of the slots for PersistentIndexHandle and, optionally, a dense numbering of the
+		//used slots (see setDenseIndexing()).
+		class NSE_EXPORT PersistentSlotAllocator
+		{
+		public:
+			typedef PersistentIndexHandle handle;
+
+			//Entry of the remap table of compact() for slots that were deleted.
+			static const size_t DeletedIndex = (size_t)-1;
 
-			bool isDeleted(size_t index)
+			//Batches with more changes than this and than 1/1024 of the slots rebuild the dense index instead of
+			//updating it for every slot.
+			static const size_t MaxIncrementalDenseUpdates = 8;
+
+			PersistentSlotAllocator()
+				: totalEmptySlots(0), denseIndexing(false)
+			{ }
+
+			//Number of slots, including deleted ones.
+			size_t size() const { return occupied.size(); }
+			size_t sizeNotDeleted() const { return occupied.size() - totalEmptySlots; }
+			size_t emptySlots() const { return totalEmptySlots; }
+
+			const OccupancyBitmap& occupancy() const { return occupied; }
+
+			//Returns a used slot. Deleted slots are reused, starting with the lowest index. A new slot is
+			//appended only if there are no deleted slots.
+			size_t insert()
 			{
-				if (index >= data.size())
-					return true;
-				for (auto& range : emptySlots)
+				if (totalEmptySlots > 0)
 				{
-					if (index < range.lowerInclusive)
-						return false;
-					if (index < range.upperExclusive)
-						return true;
+					size_t slot = freeSlots.findFirstSet();
+					freeSlots.reset(slot);
+					occupied.set(slot);
+					--totalEmptySlots;
+					if (denseIndexing)
+						dense.update(occupied, slot);
+					return slot;
+				}
+				else
+				{
+					occupied.push_back(true);
+					freeSlots.push_back(false);
+					if (generations.size() < occupied.size())
+						generations.push_back(0);
+					if (denseIndexing)
+						dense.update(occupied, occupied.size() - 1);
+					return occupied.size() - 1;
 				}
-				return false;
 			}
 
-			void erase(size_t index)
+			//Returns count slots in outIndices. The slots are the same as for count calls of insert(), but the
+			//deleted slots are found in a single pass over the occupancy bitmap and new slots are appended at once.
+			void insert_n(size_t count, std::vector<size_t>& outIndices)
 			{
-				assert(!isDeleted(index));
-
-				data[index] = T();
-
-				//find the first empty interval whose max is greater or equal to index
-				auto emptyIntervalIt = std::lower_bound(emptySlots.begin(), emptySlots.end(), index,
-					[](const Interval& interval, size_t index)
-				{
-					return interval.upperExclusive < index;
-				});
-
-				if (emptyIntervalIt == emptySlots.end())
+				//grow geometrically such that repeated calls with the same vector stay amortized O(count)
+				if (outIndices.capacity() < outIndices.size() + count)
+					outIndices.reserve(std::max(outIndices.size() + count, 2 * outIndices.capacity()));
+
+				size_t reused = std::min(count, totalEmptySlots);
+				bool incremental = denseIndexing && updatesDenseIndexIncrementally(reused);
+				size_t slot = reused > 0 ? freeSlots.findFirstSet() : 0;
+				for (size_t i = 0; i < reused; ++i, ++slot)
 				{
-					emptySlots.emplace_back(index, index + 1);
-					++totalEmptySlots;
-					return;
+					slot = occupied.findNextClear(slot);
+					occupied.set(slot);
+					freeSlots.reset(slot);
+					outIndices.push_back(slot);
+					if (incremental)
+						dense.update(occupied, slot);
 				}
+				totalEmptySlots -= reused;
+
+				size_t oldSize = occupied.size();
+				size_t newSize = oldSize + count - reused;
+				occupied.resize(newSize, true);
+				freeSlots.resize(newSize);
+				if (generations.size() < newSize)
+					generations.resize(newSize, 0);
+				for (size_t i = oldSize; i < newSize; ++i)
+					outIndices.push_back(i);
+
+				if (incremental && newSize > oldSize)
+					dense.update(occupied, oldSize);
+				else if (denseIndexing && !incremental)
+					dense.build(occupied);
+			}
 
-				if (index >= emptyIntervalIt->lowerInclusive && index < emptyIntervalIt->upperExclusive)
-					return; //index is already deleted
+			bool isDeleted(size_t index) const
+			{
+				return index >= occupied.size() || !occupied.test(index);
+			}
 
-				totalEmptySlots++;
+			//Marks the slot as deleted. Returns false if it has already been deleted.
+			bool erase(size_t index)
+			{
+				return eraseSlot(index, denseIndexing);
+			}
 
-				if (index == emptyIntervalIt->upperExclusive)
+			//Marks all slots in [begin, end) as deleted and calls erased(index) for each of them before. The
+			//indices may be unsorted. Indices of slots that are already deleted (e.g., duplicates) are ignored.
+			//Large batches are sorted by marking them in a bitmap, which is then traversed word by word such that
+			//the slots are processed in memory order.
+			template <typename Iterator, typename Func>
+			void erase_many(Iterator begin, Iterator end, const Func& erased)
+			{
+				size_t count = std::distance(begin, end);
+				bool incremental = updatesDenseIndexIncrementally(count);
+				if (count * 64 < occupied.size())
+				{
+					for (; begin != end; ++begin)
+						if (!isDeleted(*begin))
+						{
+							erased(*begin);
+							eraseSlot(*begin, denseIndexing && incremental);
+						}
+				}
+				else
 				{
-					//we can extend the interval by +1
-					emptyIntervalIt->upperExclusive++;
-					//check if we can merge with the next
-					auto nextIt = emptyIntervalIt + 1;
-					if (nextIt != emptySlots.end() && emptyIntervalIt->upperExclusive == nextIt->lowerInclusive)
+					OccupancyBitmap marked;
+					marked.resize(occupied.size());
+					for (; begin != end; ++begin)
+						if (!isDeleted(*begin))
+							marked.set(*begin);
+					for (size_t index = marked.findNextSet(0); index < marked.size(); index = marked.findNextSet(index + 1))
 					{
-						emptyIntervalIt->upperExclusive = nextIt->upperExclusive;
-						emptySlots.erase(nextIt);
+						erased(index);
+						eraseSlot(index, denseIndexing && incremental);
 					}
 				}
-				else if (index == emptyIntervalIt->lowerInclusive - 1)
+				if (denseIndexing && !incremental)
+					dense.build(occupied);
+			}
+
+			//Removes all slots and invalidates all handles.
+			void clear()
+			{
+				freeSlots.clear();
+				occupied.clear();
+				totalEmptySlots = 0;
+				dense.clear();
+				invalidateHandles();
+			}
+
+			//Assigns new dense indices to all used slots (keeping their order) and calls moveEntry(oldIndex, newIndex)
+			//for each of them. The calls are made in parallel with chunks of grainSize slots. Afterwards, the
+			//first sizeNotDeleted() slots are used and all handles are invalidated. Returns a table that maps
+			//every old index to its new index, or to DeletedIndex for slots that were deleted.
+			template <typename Func>
+			std::vector<size_t> compact(const Func& moveEntry, size_t grainSize = 65536)
+			{
+				std::vector<size_t> remap(occupied.size());
+				const auto& words = occupied.words();
+				const size_t wordsPerChunk = std::max<size_t>(1, grainSize / 64);
+				const size_t chunks = (words.size() + wordsPerChunk - 1) / wordsPerChunk;
+
+				//exclusive prefix sum over the number of used slots per chunk
+				std::vector<size_t> chunkOffset(chunks + 1, 0);
+				parallel_for_index(chunks, [&](size_t c)
+				{
+					size_t count = 0;
+					for (size_t w = c * wordsPerChunk; w < std::min(words.size(), (c + 1) * wordsPerChunk); ++w)
+						count += popCount(words[w]);
+					chunkOffset[c + 1] = count;
+				});
+				std::partial_sum(chunkOffset.begin(), chunkOffset.end(), chunkOffset.begin());
+
+				parallel_for_index(chunks, [&](size_t c)
 				{
-					//we can extend the interval by -1
-					emptyIntervalIt->lowerInclusive--;
-					//check if we can merge with the previous interval
-					if (emptyIntervalIt != emptySlots.begin())
+					size_t newIndex = chunkOffset[c];
+					size_t end = std::min(occupied.size(), (c + 1) * wordsPerChunk * 64);
+					for (size_t i = c * wordsPerChunk * 64; i < end; ++i)
 					{
-						auto prev = emptyIntervalIt - 1;
-						if (prev->upperExclusive == emptyIntervalIt->lowerInclusive)
+						if (occupied.test(i))
 						{
-							emptyIntervalIt->lowerInclusive = prev->lowerInclusive;
-							emptySlots.erase(prev);
+							remap[i] = newIndex;
+							moveEntry(i, newIndex++);
 						}
+						else
+							remap[i] = DeletedIndex;
 					}
-				}
+				});
+
+				size_t size = chunkOffset.back();
+				occupied.resize(0);
+				occupied.resize(size, true);
+				freeSlots.clear();
+				freeSlots.resize(size);
+				totalEmptySlots = 0;
+				if (denseIndexing)
+					dense.build(occupied, grainSize);
+				invalidateHandles();
+				return remap;
+			}
+
+			//Enables or disables the dense numbering of the used slots, which assigns the numbers
+			//0..sizeNotDeleted()-1 to the used slots in ascending order without moving them. This allows to
+			//store per-entry data of downstream stages (e.g., GPU buffers or solver vectors) in dense arrays
+			//without compacting the container. The numbering is kept up to date by all operations: single
+			//inserts and erases update it in O(log(n / 512)), large batches and compaction rebuild it in parallel.
+			//The numbering changes whenever a slot before the entry is inserted or erased.
+			void setDenseIndexing(bool enable, size_t grainSize = 65536)
+			{
+				denseIndexing = enable;
+				if (enable)
+					dense.build(occupied, grainSize);
 				else
-				{
-					//we have to generate a new interval
-					emptySlots.insert(emptyIntervalIt, Interval(index, index + 1));
-				}
+					dense.clear();
 			}
 
-			iterator erase(iterator it)
+			bool isDenseIndexingEnabled() const { return denseIndexing; }
+
+			//Returns the dense number of the given used slot. O(log(n / 512)). Requires dense indexing.
+			size_t denseIndexOf(size_t index) const
 			{
-				assert(!it.deleted());
+				assert(denseIndexing && !isDeleted(index));
+				return dense.rank(occupied, index);
+			}
+
+			//Returns the used slot with the given dense number. O(log(n / 512)). Requires dense indexing.
+			size_t slotOfDenseIndex(size_t denseIndex) const
+			{
+				assert(denseIndexing);
+				return dense.select(occupied, denseIndex);
+			}
 
-				*it = T();
+			//Returns a handle to the given slot, which must not be deleted.
+			handle handleOf(size_t index) const
+			{
+				assert(!isDeleted(index));
+				return handle(index, generations[index]);
+			}
 
-				totalEmptySlots++;
+			//Returns if the slot that the handle refers to has not been deleted in the meantime. O(1).
+			bool isValid(handle h) const
+			{
+				return h.index() < occupied.size() && generations[h.index()] == h.generation();
+			}
 
-				bool canExtendFromPrev = it.nextEmptyInterval != emptySlots.begin() && it.currentIndex == (it.nextEmptyInterval - 1)->upperExclusive;
-				if (it.nextEmptyInterval != emptySlots.end() && it.currentIndex == it.nextEmptyInterval->lowerInclusive - 1)
+			//Stores the deleted slots as a sorted list of intervals followed by their number.
+			template <typename Sink>
+			void saveToFile(Sink& f) const
+			{
+				std::vector<Interval> emptySlots;
+				size_t lower = occupied.findNextClear(0);
+				while (lower < occupied.size())
 				{
-					if (canExtendFromPrev)
-					{
-						//fill a gap
-						auto prevIt = it.nextEmptyInterval - 1;
-						prevIt->upperExclusive = it.nextEmptyInterval->upperExclusive;
-						auto afterDeleteIt = emptySlots.erase(it.nextEmptyInterval);
-						return iterator(it.currentIndex, afterDeleteIt - 1, this);
-					}
-					else
-					{
-						//extend next interval by -1
-						it.nextEmptyInterval->lowerInclusive--;
-						it.advanceUntilValid();
-						return it;
-					}
+					size_t upper = occupied.findNextSet(lower);
+					emptySlots.emplace_back(lower, upper);
+					lower = occupied.findNextClear(upper);
 				}
 
-				if (canExtendFromPrev)
+				nse::data::saveToFile(emptySlots, f);
+				nse::data::saveToFile(totalEmptySlots, f);
+			}
+
+			//Loads the deleted slots for a container with the given number of slots. Invalidates all handles.
+			template <typename Source>
+			void loadFromFile(Source& f, size_t size)
+			{
+				std::vector<Interval> emptySlots;
+				nse::data::loadFromFile(emptySlots, f);
+				nse::data::loadFromFile(totalEmptySlots, f);
+
+				occupied.resize(0);
+				occupied.resize(size, true);
+				freeSlots.clear();
+				freeSlots.resize(size);
+				for (auto& interval : emptySlots)
 				{
-					//extend previous interval by +1
-					(it.nextEmptyInterval - 1)->upperExclusive++;
-					it.currentIndex++;
-					it.advanceUntilValid();
-					return it;
+					occupied.resetRange(interval.lowerInclusive, interval.upperExclusive);
+					for (size_t i = interval.lowerInclusive; i < interval.upperExclusive; ++i)
+						freeSlots.set(i);
 				}
+				if (denseIndexing)
+					dense.build(occupied);
+				invalidateHandles();
+			}
+
+		private:
+			//Updating costs O(log(n / 512)) per change and rebuilding O(n / 64).
+			bool updatesDenseIndexIncrementally(size_t changes) const
+			{
+				return changes <= MaxIncrementalDenseUpdates || changes * 1024 <= occupied.size();
+			}
+
+			bool eraseSlot(size_t index, bool updateDenseIndex)
+			{
+				if (freeSlots.test(index))
+					return false;
+
+				occupied.reset(index);
+				freeSlots.set(index);
+				generations[index] = (generations[index] + 1) & handle::GenerationMask;
+				++totalEmptySlots;
+				if (updateDenseIndex)
+					dense.update(occupied, index);
+				return true;
+			}
+
+			//Increments the generations of all slots. Generations are not reset such that handles to
+			//slots that are used again later do not become valid again.
+			void invalidateHandles()
+			{
+				for (auto& g : generations)
+					g = (g + 1) & handle::GenerationMask;
+				if (generations.size() < occupied.size())
+					generations.resize(occupied.size(), 0);
+			}
+
+			HierarchicalBitmap freeSlots; //bit is set for all deleted slots
+			size_t totalEmptySlots;
+
+			OccupancyBitmap occupied; //bit is set for all slots that are not deleted
+
+			std::vector<uint32_t> generations; //may be larger than the number of slots
+
+			bool denseIndexing;
+			RankSelectIndex dense;
+		};
+
+		//Represents a container that allows add and remove while keeping indices persistent.
+		//The slots are managed by a PersistentSlotAllocator. The entries are stored in Storage, which is
+		//either std::vector or ChunkedStorage (see ChunkedPersistentIndexContainer). Both use the same
+		//file format.
+		template <typename T, typename Allocator = std::allocator<T>, typename Storage = std::vector<T, Allocator> >
+		class PersistentIndexContainer
+		{
+		public:
+
+			typedef EntryIterator<T, Allocator, Storage> iterator;
+			typedef LiveEntryRange<T, Allocator, Storage> range;
+			typedef PersistentIndexHandle handle;
+
+			//Entry of the remap table of compact() for slots that were deleted.
+			static const size_t DeletedIndex = PersistentSlotAllocator::DeletedIndex;
+
+			PersistentIndexContainer()
+				: trackDirty(false)
+			{ }
+
+			//Returns the index of the new entry. Deleted slots are reused, starting with the lowest index.
+			size_t insert()
+			{
+				if (slots.emptySlots() == 0)
+					data.emplace_back();
+				size_t index = slots.insert();
+				markDirty(index);
+				return index;
+			}
+
+			//Inserts count entries and appends their indices to outIndices. The indices are the same as for
+			//count calls of insert(), but the holes are found in a single pass over the occupancy bitmap and
+			//new slots are appended at once.
+			void insert_n(size_t count, std::vector<size_t>& outIndices)
+			{
+				data.resize(data.size() + count - std::min(count, slots.emptySlots()));
+				size_t first = outIndices.size();
+				slots.insert_n(count, outIndices);
+				if (trackDirty)
+					for (size_t i = first; i < outIndices.size(); ++i)
+						dirty.add(outIndices[i]);
+			}
+
+			//Writes through the returned reference are not recorded as modifications (see modify()).
+			T& operator[](size_t index) { return data[index]; }
+			const T& operator[](size_t index) const { return data[index]; }
+
+			//Returns the entry at index and records it as modified if dirty tracking is enabled.
+			T& modify(size_t index)
+			{
+				markDirty(index);
+				return data[index];
+			}
+
+			//Enables or disables the recording of modified slots. When enabled, insert(), erase(), modify(), and
+			//all bulk operations record the slots that they change in dirtyRanges(), which keeps at most maxRanges
+			//intervals. Changes through operator[] or iterators must be recorded with markDirty().
+			void setDirtyTracking(bool enable, size_t maxRanges = 64)
+			{
+				trackDirty = enable;
+				dirty.clear();
+				dirty.setMaxRanges(maxRanges);
+			}
+
+			bool isDirtyTrackingEnabled() const { return trackDirty; }
+
+			void markDirty(size_t index)
+			{
+				if (trackDirty)
+					dirty.add(index);
+			}
+
+			//Records the slots [begin, end) as modified.
+			void markDirty(size_t begin, size_t end)
+			{
+				if (trackDirty)
+					dirty.add(begin, end);
+			}
+
+			//Enables the dense numbering of the entries that are not deleted (see PersistentSlotAllocator::setDenseIndexing()).
+			void setDenseIndexing(bool enable, size_t grainSize = 65536) { slots.setDenseIndexing(enable, grainSize); }
+			size_t denseIndexOf(size_t index) const { return slots.denseIndexOf(index); }
+			size_t slotOfDenseIndex(size_t denseIndex) const { return slots.slotOfDenseIndex(denseIndex); }
+
+			//Returns the slots that have been modified since the last call of clearDirtyRanges().
+			const DirtyRangeSet& dirtyRanges() const { return dirty; }
+			void clearDirtyRanges() { dirty.clear(); }
+
+			//Returns a handle to the entry at the given index, which must not be deleted.
+			handle handleOf(size_t index) const { return slots.handleOf(index); }
+
+			//Returns if the entry that the handle refers to still exists. O(1).
+			bool isValid(handle h) const { return slots.isValid(h); }
+
+			//Returns the entry that the handle refers to. Throws if the entry has been erased.
+			T& get(handle h)
+			{
+				if (!isValid(h))
+					throw std::runtime_error("The handle refers to an entry that has been erased.");
+				return data[h.index()];
+			}
+
+			const T& get(handle h) const
+			{
+				if (!isValid(h))
+					throw std::runtime_error("The handle refers to an entry that has been erased.");
+				return data[h.index()];
+			}
+
+			//Returns the entry that the handle refers to or nullptr if the entry has been erased.
+			T* try_get(handle h) { return isValid(h) ? &data[h.index()] : nullptr; }
+			const T* try_get(handle h) const { return isValid(h) ? &data[h.index()] : nullptr; }
+
+			//Invalidates all handles.
+			void clear()
+			{
+				data.clear();
+				slots.clear();
+				dirty.clear();
+			}
+
+			//Moves all entries that are not deleted to a dense prefix (keeping their order) and releases the
+			//storage of the gaps. Returns a table that maps every old index to its new index, or to DeletedIndex
+			//for slots that were deleted. Large containers are compacted in parallel with chunks of grainSize
+			//slots. The entries are moved into a new array, so the peak memory consumption is the old plus the
+			//new storage. All handles are invalidated.
+			std::vector<size_t> compact(size_t grainSize = 65536)
+			{
+				Storage compacted(data.get_allocator());
+				compacted.resize(slots.sizeNotDeleted());
+				auto remap = slots.compact([&](size_t from, size_t to) { compacted[to] = std::move(data[from]); }, grainSize);
+				data.swap(compacted);
+				dirty.clear();
+				markDirty(0, data.size());
+				return remap;
+			}
+
+			void reserve(size_t additionalElements)
+			{
+				if (additionalElements > slots.emptySlots())
+					data.reserve(data.size() + additionalElements - slots.emptySlots());
+			}
+
+			size_t sizeWithGaps() const { return data.size(); }
+			size_t sizeNotDeleted() const { return slots.sizeNotDeleted(); }
+
+			bool isDeleted(size_t index) const { return slots.isDeleted(index); }
+
+			void erase(size_t index)
+			{
+				assert(!isDeleted(index));
 
-				auto slotIt = emptySlots.insert(it.nextEmptyInterval, Interval(it.currentIndex, it.currentIndex + 1));
-				return iterator(it.currentIndex, slotIt, this);
+				data[index] = T();
+				slots.erase(index);
+				markDirty(index);
+			}
+
+			//Erases all entries in [begin, end). The indices may be unsorted. Indices of entries that are
+			//already deleted (e.g., duplicates) are ignored. Large batches are processed in memory order
+			//(see PersistentSlotAllocator::erase_many()).
+			template <typename Iterator>
+			void erase_many(Iterator begin, Iterator end)
+			{
+				slots.erase_many(begin, end, [this](size_t index) { data[index] = T(); markDirty(index); });
+			}
+
+			void erase_many(const std::vector<size_t>& indices) { erase_many(indices.begin(), indices.end()); }
+
+			//Erases the entry and returns an iterator to the next entry.
+			iterator erase(iterator it)
+			{
+				assert(!it.deleted());
+				erase(it.currentIndex);
+				return ++it;
 			}
 
-			iterator begin() { return iterator(0, emptySlots.begin(), this); }
-			iterator end() { return iterator(data.size(), emptySlots.end(), this); }
+			iterator begin() { return iterator(0, this); }
+			iterator end() { return iterator(data.size(), this); }
 
-			void saveToFile(FILE* f) const
+			//Returns a splittable range over all entries that are not deleted (see LiveEntryRange).
+			range liveEntries(size_t grainSize = 4096) { return range(this, 0, data.size(), grainSize); }
+
+			//The deleted slots are stored as a sorted list of intervals.
+			template <typename Sink>
+			void saveToFile(Sink& f) const
 			{
 				nse::data::saveToFile(data, f);
-				nse::data::saveToFile(emptySlots, f);
-				nse::data::saveToFile(totalEmptySlots, f);
+				slots.saveToFile(f);
 			}
 
-			void loadFromFile(FILE* f)
+			//Invalidates all handles.
+			template <typename Source>
+			void loadFromFile(Source& f)
 			{
 				nse::data::loadFromFile(data, f);
-				nse::data::loadFromFile(emptySlots, f);
-				nse::data::loadFromFile(totalEmptySlots, f);
+				slots.loadFromFile(f, data.size());
+				dirty.clear();
+				markDirty(0, data.size());
 			}
 
 		private:
-			std::vector<T, Allocator> data;
-
-			std::deque<Interval> emptySlots; //sorted
-			size_t totalEmptySlots;
+			Storage data;
+			PersistentSlotAllocator slots;
+			DirtyRangeSet dirty;
+			bool trackDirty;
 
 			friend iterator;
+			friend range;
 		};
 
-		template <typename T, typename Allocator>
-		void saveToFile(const PersistentIndexContainer<T, Allocator>& object, FILE* f) { object.saveToFile(f); }
-		template <typename T, typename Allocator>
-		void loadFromFile(PersistentIndexContainer<T, Allocator>& object, FILE* f) { object.loadFromFile(f); }
+		template <typename T, typename Allocator, typename Storage>
+		const size_t PersistentIndexContainer<T, Allocator, Storage>::DeletedIndex;
+
+		//PersistentIndexContainer whose entries never move when the container grows. Pointers and
+		//references to entries stay valid until the entry is erased or the container is compacted.
+		template <typename T, typename Allocator = std::allocator<T>, size_t ChunkBits = 16>
+		using ChunkedPersistentIndexContainer = PersistentIndexContainer<T, Allocator, ChunkedStorage<T, Allocator, ChunkBits>>;
 
+		template <typename T, typename Allocator, typename Storage, typename Sink>
+		void saveToFile(const PersistentIndexContainer<T, Allocator, Storage>& object, Sink& f) { object.saveToFile(f); }
+		template <typename T, typename Allocator, typename Storage, typename Source>
+		void loadFromFile(PersistentIndexContainer<T, Allocator, Storage>& object, Source& f) { object.loadFromFile(f); }
 
-		template <typename T, typename Allocator>
-		class EntryIterator : public std::iterator<std::forward_iterator_tag, T>
+
+		template <typename T, typename Allocator, typename Storage>
+		class EntryIterator
 		{
 		public:
-			EntryIterator(size_t currentIndex, std::deque<Interval>::iterator nextEmptyInterval, PersistentIndexContainer<T, Allocator>* container)
-				: currentIndex(currentIndex), nextEmptyInterval(nextEmptyInterval), container(container)
+			typedef std::forward_iterator_tag iterator_category;
+			typedef T value_type;
+			typedef std::ptrdiff_t difference_type;
+			typedef T* pointer;
+			typedef T& reference;
+
+			//The iterator stops at limit even if there are further entries behind it.
+			EntryIterator(size_t currentIndex, PersistentIndexContainer<T, Allocator, Storage>* container, size_t limit = (size_t)-1)
+				: currentIndex(currentIndex), container(container), limit(limit)
 			{
 				advanceUntilValid();
 			}
 
-			EntryIterator<T, Allocator>& operator=(const EntryIterator<T, Allocator>& copy) = default;
-			EntryIterator(const EntryIterator<T, Allocator>& copy) = default;
+			EntryIterator<T, Allocator, Storage>& operator=(const EntryIterator<T, Allocator, Storage>& copy) = default;
+			EntryIterator(const EntryIterator<T, Allocator, Storage>& copy) = default;
 
-			EntryIterator<T, Allocator> operator++() { currentIndex++; advanceUntilValid(); return *this; }
-			bool operator!=(const EntryIterator<T, Allocator>& other) const { return currentIndex != other.currentIndex; }
-			bool operator==(const EntryIterator<T, Allocator>& other) const { return currentIndex == other.currentIndex; }
+			EntryIterator<T, Allocator, Storage> operator++() { currentIndex++; advanceUntilValid(); return *this; }
+			bool operator!=(const EntryIterator<T, Allocator, Storage>& other) const { return currentIndex != other.currentIndex; }
+			bool operator==(const EntryIterator<T, Allocator, Storage>& other) const { return currentIndex == other.currentIndex; }
 			T& operator*() { return container->data[currentIndex]; }
 			T* operator->() { return &container->data[currentIndex]; }
 
-			bool deleted() const
-			{
-				if (nextEmptyInterval == container->emptySlots.end())
-					return false;
-				return currentIndex >= nextEmptyInterval->lowerInclusive && currentIndex < nextEmptyInterval->upperExclusive;
-			}
+			bool deleted() const { return container->isDeleted(currentIndex); }
 
 			size_t index() const { return currentIndex; }
 
 		private:
+			//skips deleted slots word by word
 			void advanceUntilValid()
 			{
-				if (nextEmptyInterval == container->emptySlots.end())
-					return;
-				if (currentIndex >= nextEmptyInterval->lowerInclusive)
-				{
-					currentIndex = nextEmptyInterval->upperExclusive;
-					++nextEmptyInterval;
-				}
+				currentIndex = std::min(limit, container->slots.occupancy().findNextSet(currentIndex));
 			}
 
 			size_t currentIndex;
+			PersistentIndexContainer<T, Allocator, Storage>* container;
+			size_t limit;
+
+			friend class PersistentIndexContainer<T, Allocator, Storage>;
+		};
+	
+		//Range of slots [begin, end) of a PersistentIndexContainer whose iterators only visit entries that are
+		//not deleted. The range satisfies the TBB range concept and can be passed to tbb::parallel_for directly.
+		//Ranges are split at multiples of 64 slots such that every subrange skips gaps word by word in the
+		//occupancy bitmap.
+		template <typename T, typename Allocator, typename Storage>
+		class LiveEntryRange
+		{
+		public:
+			typedef EntryIterator<T, Allocator, Storage> iterator;
 
-			std::deque<Interval>::iterator nextEmptyInterval;
-			PersistentIndexContainer<T, Allocator>* container;
+			LiveEntryRange(PersistentIndexContainer<T, Allocator, Storage>* container, size_t begin, size_t end, size_t grainSize = 4096)
+				: container(container), _begin(begin), _end(end), grainSize(std::max<size_t>(64, grainSize))
+			{ }
 
-			friend class PersistentIndexContainer<T>;
+#ifdef HAVE_TBB
+			//Splits other into two halves. The new range is the first half and other becomes the second half.
+			LiveEntryRange(LiveEntryRange& other, tbb::split)
+				: container(other.container), _begin(other._begin), _end(other.splitPoint()), grainSize(other.grainSize)
+			{
+				other._begin = _end;
+			}
+#endif
+
+			bool empty() const { return _begin >= _end; }
+			bool is_divisible() const { return _end - _begin > grainSize && splitPoint() < _end; }
+
+			iterator begin() const { return iterator(_begin, container, _end); }
+			iterator end() const { return iterator(_end, container, _end); }
+
+			size_t beginSlot() const { return _begin; }
+			size_t endSlot() const { return _end; }
+
+			//Returns the subrange of the given chunk if the range is partitioned into chunks of grainSize slots.
+			size_t chunkCount() const { return (_end - _begin + chunkSize() - 1) / chunkSize(); }
+			LiveEntryRange chunk(size_t i) const
+			{
+				size_t b = _begin + i * chunkSize();
+				return LiveEntryRange(container, b, std::min(_end, b + chunkSize()), grainSize);
+			}
+
+		private:
+			size_t splitPoint() const { return (_begin + (_end - _begin) / 2 + 63) / 64 * 64; }
+			size_t chunkSize() const { return (grainSize + 63) / 64 * 64; }
+
+			PersistentIndexContainer<T, Allocator, Storage>* container;
+			size_t _begin, _end;
+			size_t grainSize;
 		};
+
+		//Calls f(entry) for all entries of the container that are not deleted in parallel. The container
+		//must not be modified structurally (insert, erase) during the call.
+		template <typename T, typename Allocator, typename Storage, typename Func>
+		void parallel_for_each(PersistentIndexContainer<T, Allocator, Storage>& container, const Func& f, size_t grainSize = 4096)
+		{
+			auto range = container.liveEntries(grainSize);
+			parallel_for_index(range.chunkCount(), [&](size_t i)
+			{
+				for (auto& entry : range.chunk(i))
+					f(entry);
+			});
+		}
+
+		//Computes reduce(init, transform(entry)...) over all entries of the container that are not deleted in
+		//parallel. reduce must be associative. Partial results are combined in slot order such that the result
+		//does not depend on the scheduling.
+		template <typename T, typename Allocator, typename Storage, typename Result, typename Reduce, typename Transform>
+		Result parallel_transform_reduce(PersistentIndexContainer<T, Allocator, Storage>& container, Result init, const Reduce& reduce,
+			const Transform& transform, size_t grainSize = 4096)
+		{
+			auto range = container.liveEntries(grainSize);
+			size_t chunks = range.chunkCount();
+			std::vector<Result> partial(chunks);
+			std::vector<char> hasPartial(chunks, 0);
+			parallel_for_index(chunks, [&](size_t i)
+			{
+				auto chunk = range.chunk(i);
+				auto it = chunk.begin();
+				if (it == chunk.end())
+					return;
+				Result result = transform(*it);
+				for (++it; it != chunk.end(); ++it)
+					result = reduce(result, transform(*it));
+				partial[i] = std::move(result);
+				hasPartial[i] = 1;
+			});
+			for (size_t i = 0; i < chunks; ++i)
+				if (hasPartial[i])
+					init = reduce(init, partial[i]);
+			return init;
+		}
 	}
-}
\ No newline at end of file
+}
@@ -0,0 +1,319 @@
+/*
+	This file is part of NSEssentials.
+
+	Use of this source code is granted via a BSD-style license, which can be found
+	in License.txt in the repository root.
+
+	@author Nico Schertler
+*/
+
+#pragma once
+
+#include <tuple>
+#include <vector>
+#include <iterator>
+#include <stdexcept>
+#include <cassert>
+
+#include "nsessentials/data/PersistentIndexContainer.h"
+
+namespace nse {
+	namespace data
+	{
+		//Contiguous view of a column of a PersistentIndexSoA. Deleted slots are contained as
+		//default-constructed entries.
+		template <typename T>
+		struct ColumnSpan
+		{
+			T* data;
+			size_t size;
+
+			T* begin() const { return data; }
+			T* end() const { return data + size; }
+			T& operator[](size_t index) const { return data[index]; }
+		};
+
+		//Iterates the indices of all slots that are used in an occupancy bitmap.
+		class LiveIndexIterator
+		{
+		public:
+			typedef std::forward_iterator_tag iterator_category;
+			typedef size_t value_type;
+			typedef std::ptrdiff_t difference_type;
+			typedef const size_t* pointer;
+			typedef size_t reference; //indices are returned by value
+
+			LiveIndexIterator(const OccupancyBitmap* occupancy, size_t index)
+				: occupancy(occupancy), index(occupancy->findNextSet(index))
+			{ }
+
+			size_t operator*() const { return index; }
+			LiveIndexIterator& operator++() { index = occupancy->findNextSet(index + 1); return *this; }
+			bool operator!=(const LiveIndexIterator& other) const { return index != other.index; }
+			bool operator==(const LiveIndexIterator& other) const { return index == other.index; }
+
+		private:
+			const OccupancyBitmap* occupancy;
+			size_t index;
+		};
+
+		struct LiveIndexRange
+		{
+			const OccupancyBitmap* occupancy;
+
+			LiveIndexIterator begin() const { return LiveIndexIterator(occupancy, 0); }
+			LiveIndexIterator end() const { return LiveIndexIterator(occupancy, occupancy->size()); }
+		};
+
+		namespace detail
+		{
+			template <size_t... I>
+			struct IndexSequence { };
+
+			template <size_t N, size_t... I>
+			struct MakeIndexSequence : MakeIndexSequence<N - 1, N - 1, I...> { };
+
+			template <size_t... I>
+			struct MakeIndexSequence<0, I...> { typedef IndexSequence<I...> type; };
+		}
+
+		//Struct-of-arrays variant of PersistentIndexContainer. Every entry consists of one element in each of
+		//the columns, which are stored in separate contiguous arrays such that sweeps over a single column can
+		//be vectorized. All columns share one PersistentSlotAllocator, so indices, slot reuse, and handles
+		//behave exactly like in PersistentIndexContainer.
+		//Example:
+		//  PersistentIndexSoA<Eigen::Vector3f, Eigen::Vector3f, uint8_t> vertices; //positions, normals, flags
+		//  size_t v = vertices.insert();
+		//  vertices.at<0>(v) = position;
+		//  for (size_t i : vertices.liveIndices())
+		//      vertices.at<1>(i).normalize();
+		//  auto flags = vertices.column<2>();
+		//Columns of type bool are not supported because std::vector<bool> is not contiguous.
+		template <typename... Columns>
+		class PersistentIndexSoA
+		{
+			typedef std::tuple<std::vector<Columns>...> ColumnTuple;
+
+			static_assert(sizeof...(Columns) > 0, "A PersistentIndexSoA needs at least one column.");
+
+		public:
+			typedef PersistentIndexHandle handle;
+
+			template <size_t Column>
+			using column_type = typename std::tuple_element<Column, std::tuple<Columns...>>::type;
+
+			static const size_t ColumnCount = sizeof...(Columns);
+
+			//Entry of the remap table of compact() for slots that were deleted.
+			static const size_t DeletedIndex = PersistentSlotAllocator::DeletedIndex;
+
+			//Returns the index of the new entry. Deleted slots are reused, starting with the lowest index.
+			size_t insert()
+			{
+				if (slots.emptySlots() == 0)
+					forEachColumn(ResizeColumn{ slots.size() + 1 });
+				return slots.insert();
+			}
+
+			//Inserts count entries and appends their indices to outIndices (see PersistentIndexContainer::insert_n()).
+			void insert_n(size_t count, std::vector<size_t>& outIndices)
+			{
+				forEachColumn(ResizeColumn{ slots.size() + count - std::min(count, slots.emptySlots()) });
+				slots.insert_n(count, outIndices);
+			}
+
+			void erase(size_t index)
+			{
+				assert(!isDeleted(index));
+				forEachColumn(ResetEntry{ index });
+				slots.erase(index);
+			}
+
+			//Erases all entries in [begin, end) (see PersistentIndexContainer::erase_many()).
+			template <typename Iterator>
+			void erase_many(Iterator begin, Iterator end)
+			{
+				slots.erase_many(begin, end, [this](size_t index) { forEachColumn(ResetEntry{ index }); });
+			}
+
+			void erase_many(const std::vector<size_t>& indices) { erase_many(indices.begin(), indices.end()); }
+
+			//Returns the element of the given column of the entry at index.
+			template <size_t Column>
+			column_type<Column>& at(size_t index) { return std::get<Column>(columns)[index]; }
+			template <size_t Column>
+			const column_type<Column>& at(size_t index) const { return std::get<Column>(columns)[index]; }
+
+			//Returns the entire column, including deleted slots. Use occupancy() or isDeleted() to mask them.
+			template <size_t Column>
+			ColumnSpan<column_type<Column>> column()
+			{
+				auto& c = std::get<Column>(columns);
+				return ColumnSpan<column_type<Column>>{ c.data(), c.size() };
+			}
+
+			template <size_t Column>
+			ColumnSpan<const column_type<Column>> column() const
+			{
+				auto& c = std::get<Column>(columns);
+				return ColumnSpan<const column_type<Column>>{ c.data(), c.size() };
+			}
+
+			//Returns the indices of all entries that are not deleted in ascending order.
+			LiveIndexRange liveIndices() const { return LiveIndexRange{ &slots.occupancy() }; }
+
+			//Bit i is set iff the entry i is not deleted.
+			const OccupancyBitmap& occupancy() const { return slots.occupancy(); }
+
+			size_t sizeWithGaps() const { return slots.size(); }
+			size_t sizeNotDeleted() const { return slots.sizeNotDeleted(); }
+			bool isDeleted(size_t index) const { return slots.isDeleted(index); }
+
+			handle handleOf(size_t index) const { return slots.handleOf(index); }
+			bool isValid(handle h) const { return slots.isValid(h); }
+
+			//Dense numbering of the entries that are not deleted (see PersistentSlotAllocator::setDenseIndexing()).
+			void setDenseIndexing(bool enable, size_t grainSize = 65536) { slots.setDenseIndexing(enable, grainSize); }
+			size_t denseIndexOf(size_t index) const { return slots.denseIndexOf(index); }
+			size_t slotOfDenseIndex(size_t denseIndex) const { return slots.slotOfDenseIndex(denseIndex); }
+
+			void reserve(size_t additionalElements)
+			{
+				if (additionalElements > slots.emptySlots())
+					forEachColumn(ReserveColumn{ slots.size() + additionalElements - slots.emptySlots() });
+			}
+
+			//Invalidates all handles.
+			void clear()
+			{
+				forEachColumn(ResizeColumn{ 0 });
+				slots.clear();
+			}
+
+			//Moves all entries that are not deleted to a dense prefix (see PersistentIndexContainer::compact()).
+			//The columns are compacted one after the other.
+			std::vector<size_t> compact(size_t grainSize = 65536)
+			{
+				auto remap = slots.compact([](size_t, size_t) { }, grainSize);
+				forEachColumn(CompactColumn{ remap, slots.size(), grainSize });
+				return remap;
+			}
+
+			//The columns are stored one after the other in the format of std::vector, followed by the
+			//deleted slots in the format of PersistentIndexContainer.
+			template <typename Sink>
+			void saveToFile(Sink& f) const
+			{
+				forEachColumn(SaveColumn<Sink>{ f });
+				slots.saveToFile(f);
+			}
+
+			//Invalidates all handles.
+			template <typename Source>
+			void loadFromFile(Source& f)
+			{
+				forEachColumn(LoadColumn<Source>{ f });
+				size_t size = std::get<0>(columns).size();
+				forEachColumn(CheckColumnSize{ size });
+				slots.loadFromFile(f, size);
+			}
+
+		private:
+			struct ResizeColumn
+			{
+				size_t size;
+				template <typename C> void operator()(C& column) const { column.resize(size); }
+			};
+
+			struct ReserveColumn
+			{
+				size_t size;
+				template <typename C> void operator()(C& column) const { column.reserve(size); }
+			};
+
+			struct ResetEntry
+			{
+				size_t index;
+				template <typename C> void operator()(C& column) const { column[index] = typename C::value_type(); }
+			};
+
+			struct CompactColumn
+			{
+				const std::vector<size_t>& remap;
+				size_t size;
+				size_t grainSize;
+
+				template <typename C> void operator()(C& column) const
+				{
+					C compacted(column.get_allocator());
+					compacted.resize(size);
+					size_t chunks = (remap.size() + grainSize - 1) / grainSize;
+					parallel_for_index(chunks, [&](size_t c)
+					{
+						size_t end = std::min(remap.size(), (c + 1) * grainSize);
+						for (size_t i = c * grainSize; i < end; ++i)
+							if (remap[i] != DeletedIndex)
+								compacted[remap[i]] = std::move(column[i]);
+					});
+					column.swap(compacted);
+				}
+			};
+
+			struct CheckColumnSize
+			{
+				size_t size;
+				template <typename C> void operator()(C& column) const
+				{
+					if (column.size() != size)
+						throw std::runtime_error("The columns of the PersistentIndexSoA have different sizes.");
+				}
+			};
+
+			template <typename Sink>
+			struct SaveColumn
+			{
+				Sink& f;
+				template <typename C> void operator()(const C& column) const { nse::data::saveToFile(column, f); }
+			};
+
+			template <typename Source>
+			struct LoadColumn
+			{
+				Source& f;
+				template <typename C> void operator()(C& column) const { nse::data::loadFromFile(column, f); }
+			};
+
+			template <typename Func>
+			void forEachColumn(const Func& f) { forEachColumn(f, typename detail::MakeIndexSequence<ColumnCount>::type()); }
+			template <typename Func>
+			void forEachColumn(const Func& f) const { forEachColumn(f, typename detail::MakeIndexSequence<ColumnCount>::type()); }
+
+			template <typename Func, size_t... I>
+			void forEachColumn(const Func& f, detail::IndexSequence<I...>)
+			{
+				int expand[] = { 0, (f(std::get<I>(columns)), 0)... };
+				(void)expand;
+			}
+
+			template <typename Func, size_t... I>
+			void forEachColumn(const Func& f, detail::IndexSequence<I...>) const
+			{
+				int expand[] = { 0, (f(std::get<I>(columns)), 0)... };
+				(void)expand;
+			}
+
+			ColumnTuple columns;
+			PersistentSlotAllocator slots;
+		};
+
+		template <typename... Columns>
+		const size_t PersistentIndexSoA<Columns...>::ColumnCount;
+		template <typename... Columns>
+		const size_t PersistentIndexSoA<Columns...>::DeletedIndex;
+
+		template <typename... Columns, typename Sink>
+		void saveToFile(const PersistentIndexSoA<Columns...>& object, Sink& f) { object.saveToFile(f); }
+		template <typename... Columns, typename Source>
+		void loadFromFile(PersistentIndexSoA<Columns...>& object, Source& f) { object.loadFromFile(f); }
+	}
+}
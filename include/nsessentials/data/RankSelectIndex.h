@@ -0,0 +1,235 @@
+/*
+	This file is part of NSEssentials.
+
+	Use of this source code is granted via a BSD-style license, which can be found
+	in License.txt in the repository root.
+
+	@author Nico Schertler
+*/
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+
+#if defined(__BMI2__) && !defined(_MSC_VER)
+#include <immintrin.h>
+#endif
+
+#include "nsessentials/data/Bitmap.h"
+#include "nsessentials/data/Parallelization.h"
+
+namespace nse {
+	namespace data
+	{
+		//Returns the position of the set bit of the given rank (0-based) in word. word must have more than
+		//rank set bits.
+		inline unsigned int selectInWord(uint64_t word, unsigned int rank)
+		{
+#if defined(__BMI2__) && !defined(_MSC_VER)
+			return countTrailingZeros(_pdep_u64(1ull << rank, word));
+#else
+			unsigned int offset = 0;
+			for (;; offset += 8)
+			{
+				unsigned int bits = popCount((word >> offset) & 0xff);
+				if (rank < bits)
+					break;
+				rank -= bits;
+			}
+			uint64_t byte = (word >> offset) & 0xff;
+			for (; rank > 0; --rank)
+				byte &= byte - 1;
+			return offset + countTrailingZeros(byte);
+#endif
+		}
+
+		//Rank/select index over an OccupancyBitmap. rank(i) returns the number of set bits before position i and
+		//select(k) returns the position of the k-th set bit, so the two functions map between the positions of
+		//the set bits and a dense numbering 0..count()-1 in both directions.
+		//The index stores the number of set bits of every superblock of 512 bits in a Fenwick tree (64 bit per
+		//superblock) and the number of set bits before every word within its superblock (16 bit), which is about
+		//0.25 bits per bit of the bitmap. rank() and select() descend the tree and then scan the at most eight
+		//words of a superblock, which is O(log(n / 512)). Flipping a bit or growing the bitmap updates the tree
+		//in O(log(n / 512)) as well.
+		//The index does not keep a reference to the bitmap, which has to be passed to all queries and must be
+		//the one that the index has been built for.
+		class RankSelectIndex
+		{
+		public:
+			static const size_t SuperblockWords = 8;
+			static const size_t SuperblockBits = SuperblockWords * 64;
+
+			RankSelectIndex()
+				: _size(0), _count(0)
+			{
+				clear();
+			}
+
+			void clear()
+			{
+				_size = 0;
+				_count = 0;
+				tree.assign(1, 0);
+				superblockCount.clear();
+				wordRank.clear();
+			}
+
+			//Builds the index from scratch. The superblocks are counted in parallel with chunks of grainSize bits.
+			void build(const OccupancyBitmap& bits, size_t grainSize = 65536)
+			{
+				resizeFor(bits);
+				const size_t superblocks = superblockCount.size();
+				const size_t superblocksPerChunk = std::max<size_t>(1, grainSize / SuperblockBits);
+				const size_t chunks = (superblocks + superblocksPerChunk - 1) / superblocksPerChunk;
+				parallel_for_index(chunks, [&](size_t c)
+				{
+					for (size_t s = c * superblocksPerChunk; s < std::min(superblocks, (c + 1) * superblocksPerChunk); ++s)
+						superblockCount[s] = countSuperblock(bits, s);
+				});
+
+				//linear-time construction of the Fenwick tree
+				tree.assign(superblocks + 1, 0);
+				_count = 0;
+				for (size_t j = 1; j <= superblocks; ++j)
+				{
+					tree[j] += superblockCount[j - 1];
+					_count += superblockCount[j - 1];
+					size_t parent = j + (j & (0 - j));
+					if (parent <= superblocks)
+						tree[parent] += tree[j];
+				}
+			}
+
+			//Updates the index after bit i of bits has been flipped or bits has grown (e.g., with push_back() or
+			//resize()); i is then the old size. Both cost O(log(n / 512)) per changed superblock.
+			void update(const OccupancyBitmap& bits, size_t i)
+			{
+				if (bits.size() != _size)
+				{
+					assert(bits.size() > _size);
+					size_t first = std::min(i, _size) / SuperblockBits;
+					size_t oldSuperblocks = superblockCount.size();
+					resizeFor(bits);
+					//superblocks that already existed may have been extended
+					for (size_t s = first; s < oldSuperblocks; ++s)
+					{
+						uint16_t count = countSuperblock(bits, s);
+						add(s, (int64_t)count - (int64_t)superblockCount[s]);
+						superblockCount[s] = count;
+					}
+					for (size_t s = oldSuperblocks; s < superblockCount.size(); ++s)
+						append(s, countSuperblock(bits, s));
+					return;
+				}
+
+				size_t w = i / 64;
+				size_t s = i / SuperblockBits;
+				int delta = bits.test(i) ? 1 : -1;
+				for (size_t v = w + 1; v < std::min(wordRank.size(), (s + 1) * SuperblockWords); ++v)
+					wordRank[v] += delta;
+				superblockCount[s] += delta;
+				add(s, delta);
+			}
+
+			//Number of set bits.
+			size_t count() const { return (size_t)_count; }
+
+			//Returns the number of set bits in [0, i). i may be at most the size of the bitmap.
+			size_t rank(const OccupancyBitmap& bits, size_t i) const
+			{
+				assert(bits.size() == _size && i <= _size);
+				if (i == _size)
+					return count();
+				size_t w = i / 64;
+				uint64_t below = bits.words()[w] & ((1ull << (i & 63)) - 1);
+				return (size_t)prefix(i / SuperblockBits) + wordRank[w] + popCount(below);
+			}
+
+			//Returns the position of the set bit with rank k, i.e., the position p with bits.test(p) and rank(p) == k.
+			//k must be less than count().
+			size_t select(const OccupancyBitmap& bits, size_t k) const
+			{
+				assert(bits.size() == _size && k < count());
+
+				//last superblock with at most k set bits before it
+				size_t s = 0;
+				uint64_t remaining = k;
+				const size_t superblocks = tree.size() - 1;
+				size_t step = 1;
+				while (step * 2 <= superblocks)
+					step *= 2;
+				for (; step > 0; step /= 2)
+					if (s + step <= superblocks && tree[s + step] <= remaining)
+					{
+						s += step;
+						remaining -= tree[s];
+					}
+
+				size_t w = s * SuperblockWords;
+				size_t end = std::min(wordRank.size(), w + SuperblockWords);
+				while (w + 1 < end && wordRank[w + 1] <= remaining)
+					++w;
+				return w * 64 + selectInWord(bits.words()[w], (unsigned int)(remaining - wordRank[w]));
+			}
+
+		private:
+			void resizeFor(const OccupancyBitmap& bits)
+			{
+				_size = bits.size();
+				size_t words = bits.words().size();
+				wordRank.resize(words);
+				superblockCount.resize((words + SuperblockWords - 1) / SuperblockWords);
+			}
+
+			//Fills the word ranks of superblock s and returns its number of set bits.
+			uint16_t countSuperblock(const OccupancyBitmap& bits, size_t s)
+			{
+				const auto& words = bits.words();
+				uint16_t count = 0;
+				for (size_t w = s * SuperblockWords; w < std::min(words.size(), (s + 1) * SuperblockWords); ++w)
+				{
+					wordRank[w] = count;
+					count += (uint16_t)popCount(words[w]);
+				}
+				return count;
+			}
+
+			//Number of set bits in the superblocks [0, s).
+			uint64_t prefix(size_t s) const
+			{
+				uint64_t sum = 0;
+				for (; s > 0; s &= s - 1)
+					sum += tree[s];
+				return sum;
+			}
+
+			//Adds delta to the count of superblock s.
+			void add(size_t s, int64_t delta)
+			{
+				_count += (uint64_t)delta;
+				for (size_t j = s + 1; j < tree.size(); j += j & (0 - j))
+					tree[j] += (uint64_t)delta;
+			}
+
+			//Appends superblock s, which must be the last one, to the tree.
+			void append(size_t s, uint16_t count)
+			{
+				assert(tree.size() == s + 1);
+				superblockCount[s] = count;
+				_count += count;
+				//node s + 1 covers the superblocks (s + 1 - lowbit(s + 1), s]
+				size_t j = s + 1;
+				tree.push_back(count + prefix(s) - prefix(j - (j & (0 - j))));
+			}
+
+			size_t _size;
+			uint64_t _count;
+			std::vector<uint64_t> tree; //Fenwick tree of the set bits of the superblocks (1-based)
+			std::vector<uint16_t> superblockCount; //set bits of every superblock
+			std::vector<uint16_t> wordRank; //set bits before every word within its superblock
+		};
+	}
+}
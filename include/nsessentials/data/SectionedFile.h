@@ -0,0 +1,145 @@
+/*
+	This file is part of NSEssentials.
+
+	Use of this source code is granted via a BSD-style license, which can be found
+	in License.txt in the repository root.
+
+	@author Nico Schertler
+*/
+
+#pragma once
+
+#include <stdio.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include "nsessentials/data/Serialization.h"
+#include "nsessentials/data/Hash.h"
+#include "nsessentials/NSELibrary.h"
+
+namespace nse {
+	namespace data
+	{
+		//Self-describing binary container that consists of named sections. The file layout is:
+		//  header:   magic "NSESECT", format version, offset of the table of contents
+		//  sections: the payload of every section as written by saveToFile()
+		//  table of contents: name, type tag, offset, size, and checksum of every section
+		//Readers only parse the header and the table of contents and load sections on demand.
+		struct SectionInfo
+		{
+			std::string name;
+			uint32_t typeTag;
+			uint64_t offset;
+			uint64_t size;
+			uint64_t checksum;
+		};
+
+		const uint32_t SectionedFileVersion = 1;
+
+		//Writes a sectioned file. The writer is itself a Sink; the checksum of a section is calculated
+		//while its content is written.
+		class NSE_EXPORT SectionedFileWriter
+		{
+		public:
+			SectionedFileWriter(const std::string& path);
+			//Closes the file if close() has not been called. Errors are only reported on stderr, so call
+			//close() explicitly to handle them.
+			~SectionedFileWriter();
+
+			SectionedFileWriter(const SectionedFileWriter&) = delete;
+			SectionedFileWriter& operator=(const SectionedFileWriter&) = delete;
+
+			//Adds a section that contains the serialized object. typeTag is an arbitrary user-defined
+			//identifier that readers can use to validate the section content.
+			template <typename T>
+			void addSection(const std::string& name, const T& object, uint32_t typeTag = 0)
+			{
+				beginSection(name, typeTag);
+				saveToFile(object, *this); //unqualified to find overloads via ADL
+				endSection();
+			}
+
+			//Starts a section whose content is written manually with write() or saveToFile(..., writer).
+			void beginSection(const std::string& name, uint32_t typeTag = 0);
+			void endSection();
+
+			//Writes raw bytes to the file. Throws if the data cannot be written.
+			void write(const void* data, size_t bytes);
+
+			//Writes the table of contents and closes the file. Throws if any data could not be written.
+			void close();
+
+		private:
+			FILE* file;
+			std::vector<SectionInfo> sections;
+			bool inSection;
+			IncrementalHash sectionHash;
+			uint64_t position;
+		};
+
+		class NSE_EXPORT SectionedFileReader
+		{
+		public:
+			SectionedFileReader(const std::string& path);
+			~SectionedFileReader();
+
+			SectionedFileReader(const SectionedFileReader&) = delete;
+			SectionedFileReader& operator=(const SectionedFileReader&) = delete;
+
+			uint32_t version() const { return _version; }
+			const std::vector<SectionInfo>& sections() const { return _sections; }
+
+			bool hasSection(const std::string& name) const;
+			const SectionInfo& section(const std::string& name) const;
+
+			//Calculates the checksum of the section and compares it to the stored one.
+			bool verifySection(const std::string& name);
+
+			//Loads a single section without touching any other section. If expectedTypeTag is
+			//not zero, it must match the stored tag. The checksum is calculated while the section is
+			//read, so the section is read only once. If verification fails, an exception is thrown and
+			//the content of object is unspecified.
+			template <typename T>
+			void loadSection(const std::string& name, T& object, uint32_t expectedTypeTag = 0, bool verify = true)
+			{
+				const SectionInfo& info = seekToSection(name, expectedTypeTag, false);
+				sectionHash = IncrementalHash();
+				hashing = verify;
+				try
+				{
+					loadFromFile(object, *this);
+				}
+				catch (...)
+				{
+					hashing = false;
+					throw;
+				}
+				hashing = false;
+				if (position() != info.offset + info.size)
+					throw std::runtime_error("Section \"" + name + "\" has not been read completely.");
+				if (verify && sectionHash.value() != info.checksum)
+					throw std::runtime_error("Section \"" + name + "\" is corrupt.");
+			}
+
+			//Positions the stream at the beginning of the section's content for manual reading. If
+			//verify is set, the section is read once to check its checksum.
+			const SectionInfo& seekToSection(const std::string& name, uint32_t expectedTypeTag = 0, bool verify = true);
+
+			//Reads raw bytes from the file (Source interface). Throws if not enough data is available.
+			void read(void* data, size_t bytes);
+
+			FILE* stream() { return file; }
+
+		private:
+			uint64_t position();
+
+			FILE* file;
+			uint32_t _version;
+			std::vector<SectionInfo> _sections;
+			IncrementalHash sectionHash;
+			bool hashing;
+		};
+	}
+}
@@ -16,88 +16,367 @@
 #include <list>
 #include <array>
 #include <stdexcept>
+#include <type_traits>
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <cstdint>
+#include <tuple>
+#include <utility>
 
 #ifdef HAVE_EIGEN
 #include <Eigen/Core>
+#include <Eigen/SparseCore>
 #endif
 
 namespace nse {
 	namespace data
 	{
+		//All serialization functions write to a Sink and read from a Source. A Sink is either a FILE* or
+		//an object with the member function
+		//  void write(const void* data, size_t bytes)
+		//A Source is either a FILE* or an object with the member function
+		//  void read(void* data, size_t bytes)
+		//that throws if not enough data is available. See Streams.h for implementations.
+
+		inline void writeBytes(FILE* f, const void* data, size_t bytes)
+		{
+			if (bytes > 0)
+				fwrite(data, 1, bytes, f);
+		}
+
+		template <typename Sink>
+		void writeBytes(Sink& sink, const void* data, size_t bytes)
+		{
+			sink.write(data, bytes);
+		}
+
+		inline void readBytes(FILE* f, void* data, size_t bytes)
+		{
+			if (bytes > 0 && fread(data, 1, bytes, f) != bytes)
+				throw std::runtime_error("Cannot read enough data from file");
+		}
+
+		template <typename Source>
+		void readBytes(Source& source, void* data, size_t bytes)
+		{
+			source.read(data, bytes);
+		}
+
+		//Sinks and sources may additionally provide the member function
+		//  void align(size_t alignment)
+		//that skips padding such that the next contiguous array starts at a multiple of the alignment.
+		//This allows to view arrays in place (see SharedMemory.h). Both sides must apply the same padding.
+		template <typename Stream>
+		auto alignStream(Stream& s, size_t alignment, int) -> decltype(s.align(alignment), void())
+		{
+			s.align(alignment);
+		}
+
+		template <typename Stream>
+		void alignStream(Stream&, size_t, long)
+		{ }
+
+		template <typename Stream>
+		void alignStream(Stream& s, size_t alignment)
+		{
+			alignStream(s, alignment, 0);
+		}
+
+		//Skips bytes of a source. Sources can provide the member function
+		//  void skip(size_t bytes)
+		//otherwise, the data is read and discarded.
+		inline void skipBytes(FILE* f, uint64_t bytes)
+		{
+#ifdef _WIN32
+			int result = _fseeki64(f, (__int64)bytes, SEEK_CUR);
+#else
+			int result = fseeko(f, (off_t)bytes, SEEK_CUR);
+#endif
+			if (result != 0)
+				throw std::runtime_error("Cannot seek in file");
+		}
+
+		template <typename Source>
+		auto skipBytes(Source& s, uint64_t bytes, int) -> decltype(s.skip((size_t)bytes), void())
+		{
+			s.skip((size_t)bytes);
+		}
+
+		template <typename Source>
+		void skipBytes(Source& s, uint64_t bytes, long)
+		{
+			char buffer[4096];
+			while (bytes > 0)
+			{
+				size_t n = (size_t)std::min<uint64_t>(bytes, sizeof(buffer));
+				readBytes(s, buffer, n);
+				bytes -= n;
+			}
+		}
+
+		template <typename Source>
+		void skipBytes(Source& s, uint64_t bytes)
+		{
+			skipBytes(s, bytes, 0);
+		}
+
+		//Determines if objects of type T are serialized as their raw memory. Contiguous
+		//sequences of such objects are read and written with a single call. This is the case for
+		//arithmetic types. Other trivially copyable types can opt in by specializing the trait to
+		//std::true_type, but only if they have no custom saveToFile()/loadFromFile(), which would
+		//otherwise be bypassed for their elements in arrays and containers.
+		template <typename T>
+		struct is_bulk_serializable : std::integral_constant<bool, std::is_arithmetic<T>::value>
+		{ };
+
+#ifdef HAVE_EIGEN
+		//Fixed-size matrices are serialized as their column-major coefficients without any size information.
+		//This matches their memory layout unless the matrix is stored in row-major order.
+		template <typename T, int Rows, int Cols, int Options, int MaxRows, int MaxCols>
+		struct is_bulk_serializable<Eigen::Matrix<T, Rows, Cols, Options, MaxRows, MaxCols>>
+			: std::integral_constant<bool, is_bulk_serializable<T>::value
+				&& Rows != Eigen::Dynamic && Cols != Eigen::Dynamic && Rows == MaxRows && Cols == MaxCols
+				&& (!(Options & Eigen::RowMajor) || Rows == 1 || Cols == 1)
+				&& sizeof(Eigen::Matrix<T, Rows, Cols, Options, MaxRows, MaxCols>) == Rows * Cols * sizeof(T)>
+		{ };
+#endif
+
+		//Declarations of all overloads such that nested containers resolve to the correct overload
+		template <typename T, typename Allocator, typename Sink> void saveToFile(const std::vector<T, Allocator>& object, Sink& f);
+		template <typename T, typename Allocator, typename Source> void loadFromFile(std::vector<T, Allocator>& object, Source& f);
+		template <typename Allocator, typename Sink> void saveToFile(const std::vector<bool, Allocator>& object, Sink& f);
+		template <typename Allocator, typename Source> void loadFromFile(std::vector<bool, Allocator>& object, Source& f);
+		template <typename T, typename Allocator, typename Sink> void saveToFile(const std::deque<T, Allocator>& object, Sink& f);
+		template <typename T, typename Allocator, typename Source> void loadFromFile(std::deque<T, Allocator>& object, Source& f);
+		template <typename T, size_t Size, typename Sink> void saveToFile(const std::array<T, Size>& object, Sink& f);
+		template <typename T, size_t Size, typename Source> void loadFromFile(std::array<T, Size>& object, Source& f);
+		template <typename T, typename Allocator, typename Sink> void saveToFile(const std::list<T, Allocator>& object, Sink& f);
+		template <typename T, typename Allocator, typename Source> void loadFromFile(std::list<T, Allocator>& object, Source& f);
+		template <typename K, typename T, typename Pr, typename Allocator, typename Sink> void saveToFile(const std::map<K, T, Pr, Allocator>& object, Sink& f);
+		template <typename K, typename T, typename Pr, typename Allocator, typename Source> void loadFromFile(std::map<K, T, Pr, Allocator>& object, Source& f);
+#ifdef HAVE_EIGEN
+		template <typename T, int Rows, int Cols, int Options, int MaxRows, int MaxCols, typename Sink> void saveToFile(const Eigen::Matrix<T, Rows, Cols, Options, MaxRows, MaxCols>& object, Sink& f);
+		template <typename T, int Rows, int Cols, int Options, int MaxRows, int MaxCols, typename Source> void loadFromFile(Eigen::Matrix<T, Rows, Cols, Options, MaxRows, MaxCols>& object, Source& f);
+		template <typename T, int Options, typename StorageIndex, typename Sink> void saveToFile(const Eigen::SparseMatrix<T, Options, StorageIndex>& object, Sink& f);
+		template <typename T, int Options, typename StorageIndex, typename Source> void loadFromFile(Eigen::SparseMatrix<T, Options, StorageIndex>& object, Source& f);
+#endif
+
+		//Size of the staging buffer that is used to serialize non-contiguous sequences of bulk-serializable types.
+		const size_t SerializationStagingBytes = 1 << 16;
+
 		//Generic implementation
+		template <typename T, typename Sink>
+		void saveToFile(const T& object, Sink& f)
+		{
+			writeBytes(f, &object, sizeof(T));
+		}
+
+		template <typename T, typename Source>
+		void loadFromFile(T& object, Source& f)
+		{
+			readBytes(f, &object, sizeof(T));
+		}
+
+		//Compatibility with temporary FILE* arguments
 		template <typename T>
-		void saveToFile(const T& object, FILE* f)
+		void saveToFile(const T& object, FILE*&& f)
 		{
-			fwrite(&object, sizeof(T), 1, f);
+			FILE* file = f;
+			saveToFile(object, file);
 		}
 
 		template <typename T>
-		void loadFromFile(T& object, FILE* f)
+		void loadFromFile(T&& object, FILE*&& f)
 		{
-			if(fread(&object, sizeof(T), 1, f) != 1)
-				throw std::runtime_error("Cannot read enough data from file");
+			FILE* file = f;
+			loadFromFile(std::forward<T>(object), file);
 		}
 
+		//Contiguous arrays. The file format is the same as if every element was saved individually.
+		template <typename T, typename Sink>
+		typename std::enable_if<is_bulk_serializable<T>::value>::type saveArrayToFile(const T* data, size_t n, Sink& f)
+		{
+			alignStream(f, alignof(T));
+			writeBytes(f, data, n * sizeof(T));
+		}
 
-		//std::vector
-		template <typename T, typename Allocator>
-		void saveToFile(const std::vector<T, Allocator>& object, FILE* f)
+		template <typename T, typename Sink>
+		typename std::enable_if<!is_bulk_serializable<T>::value>::type saveArrayToFile(const T* data, size_t n, Sink& f)
 		{
-			size_t n = object.size();
-			saveToFile(n, f);
 			for (size_t i = 0; i < n; ++i)
-				saveToFile(object[i], f);
+				saveToFile(data[i], f);
+		}
+
+		template <typename T, typename Source>
+		typename std::enable_if<is_bulk_serializable<T>::value>::type loadArrayFromFile(T* data, size_t n, Source& f)
+		{
+			alignStream(f, alignof(T));
+			readBytes(f, data, n * sizeof(T));
+		}
+
+		template <typename T, typename Source>
+		typename std::enable_if<!is_bulk_serializable<T>::value>::type loadArrayFromFile(T* data, size_t n, Source& f)
+		{
+			for (size_t i = 0; i < n; ++i)
+				loadFromFile(data[i], f);
+		}
+
+		//Non-contiguous ranges. Bulk-serializable elements are moved through a staging buffer.
+		template <typename Iterator, typename Sink>
+		void saveRangeToFile(Iterator begin, size_t n, Sink& f, std::false_type /* bulk */)
+		{
+			for (size_t i = 0; i < n; ++i, ++begin)
+				saveToFile(*begin, f);
+		}
+
+		template <typename Iterator, typename Sink>
+		void saveRangeToFile(Iterator begin, size_t n, Sink& f, std::true_type /* bulk */)
+		{
+			typedef typename std::iterator_traits<Iterator>::value_type T;
+			const size_t stagingSize = std::max<size_t>(1, SerializationStagingBytes / sizeof(T));
+			std::unique_ptr<T[]> staging(new T[std::min(n, stagingSize)]);
+			while (n > 0)
+			{
+				size_t batch = std::min(n, stagingSize);
+				std::copy_n(begin, batch, staging.get());
+				std::advance(begin, batch);
+				saveArrayToFile(staging.get(), batch, f);
+				n -= batch;
+			}
+		}
+
+		template <typename Iterator, typename Sink>
+		void saveRangeToFile(Iterator begin, size_t n, Sink& f)
+		{
+			saveRangeToFile(begin, n, f, is_bulk_serializable<typename std::iterator_traits<Iterator>::value_type>());
+		}
+
+		template <typename Iterator, typename Source>
+		void loadRangeFromFile(Iterator begin, size_t n, Source& f, std::false_type /* bulk */)
+		{
+			for (size_t i = 0; i < n; ++i, ++begin)
+				loadFromFile(*begin, f);
+		}
+
+		template <typename Iterator, typename Source>
+		void loadRangeFromFile(Iterator begin, size_t n, Source& f, std::true_type /* bulk */)
+		{
+			typedef typename std::iterator_traits<Iterator>::value_type T;
+			const size_t stagingSize = std::max<size_t>(1, SerializationStagingBytes / sizeof(T));
+			std::unique_ptr<T[]> staging(new T[std::min(n, stagingSize)]);
+			while (n > 0)
+			{
+				size_t batch = std::min(n, stagingSize);
+				loadArrayFromFile(staging.get(), batch, f);
+				begin = std::copy_n(staging.get(), batch, begin);
+				n -= batch;
+			}
+		}
+
+		template <typename Iterator, typename Source>
+		void loadRangeFromFile(Iterator begin, size_t n, Source& f)
+		{
+			loadRangeFromFile(begin, n, f, is_bulk_serializable<typename std::iterator_traits<Iterator>::value_type>());
 		}
 
-		template <typename T, typename Allocator>
-		void loadFromFile(std::vector<T, Allocator>& object, FILE* f)
+		//Containers are stored as their element count followed by the elements. Loading reuses the
+		//storage of the target container: capacity, list nodes, map nodes of keys that are loaded again,
+		//and the storage of nested containers. To pre-size other data structures before the elements
+		//are read, the loading can be split into
+		//  size_t n = loadSizeFromFile(f);
+		//  loadElementsFromFile(container, n, f);
+		template <typename Source>
+		size_t loadSizeFromFile(Source& f)
 		{
 			size_t n;
 			loadFromFile(n, f);
+			return n;
+		}
+
+		//std::vector
+		template <typename T, typename Allocator, typename Sink>
+		void saveToFile(const std::vector<T, Allocator>& object, Sink& f)
+		{
+			size_t n = object.size();
+			saveToFile(n, f);
+			saveArrayToFile(object.data(), n, f);
+		}
+
+		template <typename T, typename Allocator, typename Source>
+		void loadElementsFromFile(std::vector<T, Allocator>& object, size_t n, Source& f)
+		{
 			object.resize(n);
-			for (size_t i = 0; i < n; ++i)
-				loadFromFile(object[i], f);
+			loadArrayFromFile(object.data(), n, f);
+		}
+
+		template <typename T, typename Allocator, typename Source>
+		void loadFromFile(std::vector<T, Allocator>& object, Source& f)
+		{
+			loadElementsFromFile(object, loadSizeFromFile(f), f);
+		}
+
+		//std::vector<bool> has no contiguous storage and its elements are proxies
+		template <typename Allocator, typename Sink>
+		void saveToFile(const std::vector<bool, Allocator>& object, Sink& f)
+		{
+			size_t n = object.size();
+			saveToFile(n, f);
+			saveRangeToFile(object.begin(), n, f);
+		}
+
+		template <typename Allocator, typename Source>
+		void loadElementsFromFile(std::vector<bool, Allocator>& object, size_t n, Source& f)
+		{
+			object.resize(n);
+			loadRangeFromFile(object.begin(), n, f);
+		}
+
+		template <typename Allocator, typename Source>
+		void loadFromFile(std::vector<bool, Allocator>& object, Source& f)
+		{
+			loadElementsFromFile(object, loadSizeFromFile(f), f);
 		}
 
 
 		//std::deque
-		template <typename T, typename Allocator>
-		void saveToFile(const std::deque<T, Allocator>& object, FILE* f)
+		template <typename T, typename Allocator, typename Sink>
+		void saveToFile(const std::deque<T, Allocator>& object, Sink& f)
 		{
 			size_t n = object.size();
 			saveToFile(n, f);
-			for (size_t i = 0; i < n; ++i)
-				saveToFile(object[i], f);
+			saveRangeToFile(object.begin(), n, f);
 		}
 
-		template <typename T, typename Allocator>
-		void loadFromFile(std::deque<T, Allocator>& object, FILE* f)
+		template <typename T, typename Allocator, typename Source>
+		void loadElementsFromFile(std::deque<T, Allocator>& object, size_t n, Source& f)
 		{
-			size_t n;
-			loadFromFile(n, f);
 			object.resize(n);
-			for (size_t i = 0; i < n; ++i)
-				loadFromFile(object[i], f);
+			loadRangeFromFile(object.begin(), n, f);
+		}
+
+		template <typename T, typename Allocator, typename Source>
+		void loadFromFile(std::deque<T, Allocator>& object, Source& f)
+		{
+			loadElementsFromFile(object, loadSizeFromFile(f), f);
 		}
 
 		//std::array
-		template <typename T, size_t Size>
-		void saveToFile(const std::array<T, Size>& object, FILE* f)
+		template <typename T, size_t Size, typename Sink>
+		void saveToFile(const std::array<T, Size>& object, Sink& f)
 		{
-			for (size_t i = 0; i < Size; ++i)
-				saveToFile(object[i], f);
+			saveArrayToFile(object.data(), Size, f);
 		}
 
-		template <typename T, size_t Size>
-		void loadFromFile(std::array<T, Size>& object, FILE* f)
+		template <typename T, size_t Size, typename Source>
+		void loadFromFile(std::array<T, Size>& object, Source& f)
 		{
-			for (size_t i = 0; i < Size; ++i)
-				loadFromFile(object[i], f);
+			loadArrayFromFile(object.data(), Size, f);
 		}
 
 		//std::list
-		template <typename T, typename Allocator>
-		void saveToFile(const std::list<T, Allocator>& object, FILE* f)
+		template <typename T, typename Allocator, typename Sink>
+		void saveToFile(const std::list<T, Allocator>& object, Sink& f)
 		{
 			size_t n = object.size();
 			saveToFile(n, f);
@@ -105,22 +384,23 @@ namespace nse {
 				saveToFile(entry, f);
 		}
 
-		template <typename T, typename Allocator>
-		void loadFromFile(std::list<T, Allocator>& object, FILE* f)
+		//Existing nodes are overwritten, only missing nodes are allocated.
+		template <typename T, typename Allocator, typename Source>
+		void loadElementsFromFile(std::list<T, Allocator>& object, size_t n, Source& f)
 		{
-			size_t n;
-			loadFromFile(n, f);
-			object.clear();
-			for (size_t i = 0; i < n; ++i)
-			{
-				object.emplace_back();
-				nse::data::loadFromFile(object.back(), f);
-			}
+			object.resize(n);
+			loadRangeFromFile(object.begin(), n, f);
+		}
+
+		template <typename T, typename Allocator, typename Source>
+		void loadFromFile(std::list<T, Allocator>& object, Source& f)
+		{
+			loadElementsFromFile(object, loadSizeFromFile(f), f);
 		}
 
 		//std::map
-		template <typename K, typename T, typename Pr, typename Allocator>
-		void saveToFile(const std::map<K, T, Pr, Allocator>& object, FILE* f)
+		template <typename K, typename T, typename Pr, typename Allocator, typename Sink>
+		void saveToFile(const std::map<K, T, Pr, Allocator>& object, Sink& f)
 		{
 			size_t n = object.size();
 			saveToFile(n, f);
@@ -131,36 +411,59 @@ namespace nse {
 			}
 		}
 
-		template <typename K, typename T, typename Pr, typename Allocator>
-		void loadFromFile(std::map<K, T, Pr, Allocator>& object, FILE* f)
+		//Maps are stored in key order. The stored keys are merged with the existing ones: nodes of keys
+		//that are loaded again are reused, new keys are inserted with a hint in amortized constant time.
+		template <typename K, typename T, typename Pr, typename Allocator, typename Source>
+		void loadElementsFromFile(std::map<K, T, Pr, Allocator>& object, size_t n, Source& f)
 		{
-			size_t n;
-			nse::data::loadFromFile(n, f);
-			object.clear();
-			for(size_t i = 0; i < n; ++i)
+			auto comp = object.key_comp();
+			auto it = object.begin();
+			K key;
+			for (size_t i = 0; i < n; ++i)
 			{
-				K key;
-				nse::data::loadFromFile(key, f);
-				auto& entry = object[key];
-				nse::data::loadFromFile(entry, f);
+				loadFromFile(key, f);
+				while (it != object.end() && comp(it->first, key))
+					it = object.erase(it);
+				if (it == object.end() || comp(key, it->first))
+				{
+					auto inserted = object.emplace_hint(it, std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple());
+					loadFromFile(inserted->second, f);
+				}
+				else
+				{
+					loadFromFile(it->second, f);
+					++it;
+				}
 			}
+			object.erase(it, object.end());
+		}
+
+		template <typename K, typename T, typename Pr, typename Allocator, typename Source>
+		void loadFromFile(std::map<K, T, Pr, Allocator>& object, Source& f)
+		{
+			loadElementsFromFile(object, loadSizeFromFile(f), f);
 		}
 
 #ifdef HAVE_EIGEN
-		template <typename T, int Rows, int Cols, int Options, int MaxRows, int MaxCols>
-		void saveToFile(const Eigen::Matrix<T, Rows, Cols, Options, MaxRows, MaxCols>& object, FILE* f)
+		template <typename T, int Rows, int Cols, int Options, int MaxRows, int MaxCols, typename Sink>
+		void saveToFile(const Eigen::Matrix<T, Rows, Cols, Options, MaxRows, MaxCols>& object, Sink& f)
 		{
 			if(Rows == Eigen::Dynamic)
 				saveToFile(object.rows(), f);
 			if(Cols == Eigen::Dynamic)
 				saveToFile(object.cols(), f);
-			for (int c = 0; c < object.cols(); ++c)
-				for (int r = 0; r < object.rows(); ++r)
-					saveToFile(object.coeff(r, c), f);
+			if (object.IsRowMajor && object.rows() > 1 && object.cols() > 1)
+			{
+				//the file stores coefficients in column-major order
+				Eigen::Matrix<T, Rows, Cols, (Options & ~Eigen::RowMajor) | Eigen::ColMajor, MaxRows, MaxCols> colMajor = object;
+				saveArrayToFile(colMajor.data(), colMajor.size(), f);
+			}
+			else
+				saveArrayToFile(object.data(), object.size(), f);
 		}
 
-		template <typename T, int Rows, int Cols, int Options, int MaxRows, int MaxCols>
-		void loadFromFile(Eigen::Matrix<T, Rows, Cols, Options, MaxRows, MaxCols>& object, FILE* f)
+		template <typename T, int Rows, int Cols, int Options, int MaxRows, int MaxCols, typename Source>
+		void loadFromFile(Eigen::Matrix<T, Rows, Cols, Options, MaxRows, MaxCols>& object, Source& f)
 		{
 			decltype(object.rows()) rows, cols;
 			if (Rows == Eigen::Dynamic)
@@ -174,9 +477,72 @@ namespace nse {
 				cols = Cols;
 
 			object.resize(rows, cols);
-			for (int c = 0; c < object.cols(); ++c)
-				for (int r = 0; r < object.rows(); ++r)
-					loadFromFile(object.coeffRef(r, c), f);
+			if (object.IsRowMajor && object.rows() > 1 && object.cols() > 1)
+			{
+				Eigen::Matrix<T, Rows, Cols, (Options & ~Eigen::RowMajor) | Eigen::ColMajor, MaxRows, MaxCols> colMajor(rows, cols);
+				loadArrayFromFile(colMajor.data(), colMajor.size(), f);
+				object = colMajor;
+			}
+			else
+				loadArrayFromFile(object.data(), object.size(), f);
+		}
+
+		//Number of zero bytes that follow an array of the given size in a sparse matrix record such that
+		//the next array starts at a multiple of 8 bytes from the beginning of the record.
+		inline size_t sparseArrayPadding(size_t bytes) { return (8 - bytes % 8) % 8; }
+
+		//Sparse matrices are stored with their compressed storage:
+		//  rows, cols, number of non-zeros n (all 64 bit),
+		//  outer indices (outerSize + 1), inner indices (n), values (n)
+		//Every array is padded with zeros to a multiple of 8 bytes, so all arrays are naturally aligned if
+		//the record starts at an aligned offset (e.g., at the beginning of a file) and a mapped file can be
+		//viewed in place (see MappedReader::readSparseMatrix()). Uncompressed matrices (e.g., after
+		//QuadraticEnergy::fixVariable()) are compressed before they are stored, so the reserved space of
+		//their columns is not written and the output only depends on the matrix content.
+		template <typename T, int Options, typename StorageIndex, typename Sink>
+		void saveToFile(const Eigen::SparseMatrix<T, Options, StorageIndex>& object, Sink& f)
+		{
+			if (!object.isCompressed())
+			{
+				Eigen::SparseMatrix<T, Options, StorageIndex> compressed = object;
+				compressed.makeCompressed();
+				saveToFile(compressed, f);
+				return;
+			}
+
+			const uint64_t zero = 0;
+			uint64_t rows = object.rows(), cols = object.cols();
+			saveToFile(rows, f);
+			saveToFile(cols, f);
+			auto outerSize = object.outerSize();
+			uint64_t n = object.nonZeros();
+			saveToFile(n, f);
+			saveArrayToFile(object.outerIndexPtr(), outerSize + 1, f);
+			writeBytes(f, &zero, sparseArrayPadding((outerSize + 1) * sizeof(StorageIndex)));
+			saveArrayToFile(object.innerIndexPtr(), (size_t)n, f);
+			writeBytes(f, &zero, sparseArrayPadding((size_t)n * sizeof(StorageIndex)));
+			saveArrayToFile(object.valuePtr(), (size_t)n, f);
+			writeBytes(f, &zero, sparseArrayPadding((size_t)n * sizeof(T)));
+		}
+
+		template <typename T, int Options, typename StorageIndex, typename Source>
+		void loadFromFile(Eigen::SparseMatrix<T, Options, StorageIndex>& object, Source& f)
+		{
+			uint64_t rows, cols, n;
+			loadFromFile(rows, f);
+			loadFromFile(cols, f);
+			loadFromFile(n, f);
+
+			object.resize((Eigen::Index)rows, (Eigen::Index)cols);
+			object.makeCompressed();
+			object.resizeNonZeros((Eigen::Index)n);
+			auto outerSize = object.outerSize();
+			loadArrayFromFile(object.outerIndexPtr(), outerSize + 1, f);
+			skipBytes(f, sparseArrayPadding((outerSize + 1) * sizeof(StorageIndex)));
+			loadArrayFromFile(object.innerIndexPtr(), (size_t)n, f);
+			skipBytes(f, sparseArrayPadding((size_t)n * sizeof(StorageIndex)));
+			loadArrayFromFile(object.valuePtr(), (size_t)n, f);
+			skipBytes(f, sparseArrayPadding((size_t)n * sizeof(T)));
 		}
 #endif
 	}
@@ -0,0 +1,97 @@
+/*
+	This file is part of NSEssentials.
+
+	Use of this source code is granted via a BSD-style license, which can be found
+	in License.txt in the repository root.
+
+	@author Nico Schertler
+*/
+
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+#include "nsessentials/data/MappedFile.h"
+#include "nsessentials/NSELibrary.h"
+
+namespace nse {
+	namespace data
+	{
+		//Named shared memory region that can be used to hand serialized data to another process
+		//without copying it through files. The writer is a sink for saveToFile() that aligns all
+		//contiguous arrays. Readers attach to the region and access vectors, dense and sparse matrices
+		//as views via MappedReader. Usage:
+		//  Process A:                                  Process B:
+		//  SharedMemoryWriter shm("/system");          SharedMemoryReader shm("/system");
+		//  saveToFile(A, shm);                         auto reader = shm.reader();
+		//  saveToFile(b, shm);                         auto A = reader.readSparseMatrix<double>();
+		//  shm.close();                                auto b = reader.readMatrix<double, Eigen::Dynamic, 1>();
+		//The region persists until it is removed with SharedMemoryWriter::remove() (on Windows, until
+		//the last handle is closed).
+		class NSE_EXPORT SharedMemoryWriter
+		{
+		public:
+			//Creates or replaces the region with the given name (must start with '/' on POSIX systems).
+			//The region grows as needed on POSIX systems. On Windows, the capacity cannot be exceeded.
+			SharedMemoryWriter(const std::string& name, size_t initialCapacity = 64 * 1024 * 1024);
+			//Closes the region if it has not been closed before.
+			~SharedMemoryWriter();
+
+			SharedMemoryWriter(const SharedMemoryWriter&) = delete;
+			SharedMemoryWriter& operator=(const SharedMemoryWriter&) = delete;
+
+			void write(const void* data, size_t bytes);
+
+			//Pads the payload such that the next write starts at a multiple of the alignment.
+			void align(size_t alignment);
+
+			size_t position() const { return payloadSize; }
+
+			//Marks the payload as complete and unmaps the region. Readers can only attach afterwards.
+			void close();
+
+			//Removes the region with the given name. Attached readers stay valid.
+			static void remove(const std::string& name);
+
+		private:
+			void reserve(size_t payloadBytes);
+
+			std::string name;
+			char* mapping;
+			size_t capacity;
+			size_t payloadSize;
+#ifdef _WIN32
+			void* mappingHandle;
+#else
+			int fd;
+#endif
+		};
+
+		//Read-only attachment to a region that has been created with SharedMemoryWriter.
+		class NSE_EXPORT SharedMemoryReader
+		{
+		public:
+			SharedMemoryReader(const std::string& name);
+			~SharedMemoryReader();
+
+			SharedMemoryReader(const SharedMemoryReader&) = delete;
+			SharedMemoryReader& operator=(const SharedMemoryReader&) = delete;
+
+			//Returns a reader over the payload. All views are valid as long as this object exists.
+			MappedReader reader() const { return MappedReader(payload, payloadSize, true); }
+
+			const char* data() const { return payload; }
+			size_t size() const { return payloadSize; }
+
+		private:
+			const char* mapping;
+			size_t mappingSize;
+			const char* payload;
+			size_t payloadSize;
+#ifdef _WIN32
+			void* mappingHandle;
+#endif
+		};
+	}
+}
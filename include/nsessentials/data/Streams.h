@@ -0,0 +1,115 @@
+/*
+	This file is part of NSEssentials.
+
+	Use of this source code is granted via a BSD-style license, which can be found
+	in License.txt in the repository root.
+
+	@author Nico Schertler
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstring>
+
+#include "nsessentials/data/Serialization.h"
+#include "nsessentials/NSELibrary.h"
+
+//Sinks and sources for the serialization functions in Serialization.h. Other implementations are
+//  FILE*                       - stdio streams
+//  MappedReader (MappedFile.h) - source for arbitrary memory regions
+//  AsyncFileWriter (AsyncWriter.h) - sink that writes on a background thread
+
+namespace nse {
+	namespace data
+	{
+		//Sink that appends all data to a growable memory buffer.
+		class MemorySink
+		{
+		public:
+			void write(const void* data, size_t bytes)
+			{
+				size_t offset = _buffer.size();
+				_buffer.resize(offset + bytes);
+				if (bytes > 0)
+					std::memcpy(_buffer.data() + offset, data, bytes);
+			}
+
+			void clear() { _buffer.clear(); }
+
+			const char* data() const { return _buffer.data(); }
+			size_t size() const { return _buffer.size(); }
+
+			std::vector<char>& buffer() { return _buffer; }
+			const std::vector<char>& buffer() const { return _buffer; }
+
+		private:
+			std::vector<char> _buffer;
+		};
+
+		//Sink that writes to a raw file descriptor through a large user-space buffer. Writes that
+		//are larger than the buffer bypass it.
+		class NSE_EXPORT FileDescriptorSink
+		{
+		public:
+			//Creates or truncates the specified file.
+			FileDescriptorSink(const std::string& path, size_t bufferSize = 4 * 1024 * 1024);
+			//Writes to an open descriptor that remains owned by the caller.
+			FileDescriptorSink(int fd, size_t bufferSize = 4 * 1024 * 1024);
+			//Calls close() if it has not been called. Errors are only reported on stderr, so call close()
+			//explicitly to handle them.
+			~FileDescriptorSink();
+
+			FileDescriptorSink(const FileDescriptorSink&) = delete;
+			FileDescriptorSink& operator=(const FileDescriptorSink&) = delete;
+
+			void write(const void* data, size_t bytes);
+
+			//Writes the buffer to the descriptor.
+			void flush();
+
+			//Flushes the buffer and closes the descriptor if it is owned. Throws if any data could not
+			//be written or the descriptor cannot be closed. The sink cannot be used afterwards.
+			void close();
+
+			int descriptor() const { return fd; }
+
+		private:
+			void writeToDescriptor(const char* data, size_t bytes);
+
+			int fd;
+			bool ownsDescriptor;
+			bool closed;
+			std::vector<char> buffer;
+			size_t buffered;
+		};
+
+		//Source that reads from a raw file descriptor through a large user-space buffer. Reads that
+		//are larger than the buffer bypass it.
+		class NSE_EXPORT FileDescriptorSource
+		{
+		public:
+			FileDescriptorSource(const std::string& path, size_t bufferSize = 4 * 1024 * 1024);
+			//Reads from an open descriptor that remains owned by the caller.
+			FileDescriptorSource(int fd, size_t bufferSize = 4 * 1024 * 1024);
+			~FileDescriptorSource();
+
+			FileDescriptorSource(const FileDescriptorSource&) = delete;
+			FileDescriptorSource& operator=(const FileDescriptorSource&) = delete;
+
+			void read(void* data, size_t bytes);
+
+			int descriptor() const { return fd; }
+
+		private:
+			//Reads up to bytes from the descriptor. Returns the number of bytes read.
+			size_t readFromDescriptor(char* data, size_t bytes);
+
+			int fd;
+			bool ownsDescriptor;
+			std::vector<char> buffer;
+			size_t bufferBegin, bufferEnd;
+		};
+	}
+}
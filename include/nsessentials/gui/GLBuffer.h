@@ -14,6 +14,7 @@
 #include <nanogui/glutil.h>
 
 #include "nsessentials/NSELibrary.h"
+#include "nsessentials/data/PersistentIndexContainer.h"
 
 namespace nse {
 	namespace gui
@@ -28,6 +29,21 @@ namespace nse {
 #endif
 		};
 
+		//Component type and dimension of the elements that GLBuffer uploads from containers.
+		template <typename T>
+		struct GLElementTraits
+		{
+			typedef T Scalar;
+			static const int Dim = 1;
+		};
+
+		template <typename S, int Rows>
+		struct GLElementTraits<Eigen::Matrix<S, Rows, 1>>
+		{
+			typedef S Scalar;
+			static const int Dim = Rows;
+		};
+
 		//Represents a generic OpenGL buffer
 		class NSE_EXPORT GLBuffer
 		{
@@ -81,6 +97,40 @@ namespace nse {
 				return *this;
 			}
 
+			//Uploads the entries of a PersistentIndexContainer that records dirty ranges (see
+			//PersistentIndexContainer::setDirtyTracking()) and clears the ranges afterwards. If the buffer
+			//already holds the container with the same size, only the dirty ranges are overwritten with
+			//glBufferSubData, so the cost scales with the size of the edit. Otherwise (first upload, entries
+			//have been appended, or the container has been compacted), the entire container is uploaded.
+			//Without dirty tracking, modifications cannot be detected and the entire container is uploaded
+			//on every call. Deleted slots are uploaded as default-constructed entries.
+			template <typename T, typename Allocator>
+			GLBuffer& uploadDirtyRanges(nse::data::PersistentIndexContainer<T, Allocator>& container)
+			{
+				typedef typename GLElementTraits<T>::Scalar Scalar;
+				const int Dim = GLElementTraits<T>::Dim;
+				static_assert(sizeof(T) == Dim * sizeof(Scalar), "The entries must be tightly packed.");
+
+				uint32_t components = (uint32_t)container.sizeWithGaps() * Dim;
+				if (id == 0 || size != components || dim != (GLuint)Dim || compSize != sizeof(Scalar)
+					|| !container.isDirtyTrackingEnabled())
+				{
+					GLuint glType = (GLuint)nanogui::detail::type_traits<Scalar>::type;
+					bool integral = (bool)nanogui::detail::type_traits<Scalar>::integral;
+					uploadData(components, Dim, sizeof(Scalar), glType, integral,
+						components == 0 ? nullptr : (const uint8_t *)&container[0]);
+				}
+				else
+				{
+					for (auto& range : container.dirtyRanges())
+						uploadSubData(range.lowerInclusive * sizeof(T), (range.upperExclusive - range.lowerInclusive) * sizeof(T),
+							&container[range.lowerInclusive]);
+				}
+				container.clearDirtyRanges();
+
+				return *this;
+			}
+
 			/// Download the data from the vertex buffer object into an Eigen matrix
 			template <typename Matrix>
 			void downloadData(Matrix &M)
@@ -106,6 +156,9 @@ namespace nse {
 			void uploadData(uint32_t size, int dim,
 				uint32_t compSize, GLuint glType, bool integral,
 				const uint8_t *data);
+			//Overwrites bytes bytes at the given byte offset without reallocating the buffer. The buffer
+			//must have been created with uploadData() and the range must lie within its storage.
+			void uploadSubData(size_t offset, size_t bytes, const void *data);
 			void downloadData(uint32_t size, int dim,
 				uint32_t compSize, GLuint glType, uint8_t *data);
 
@@ -12,6 +12,7 @@
 #ifdef HAVE_EIGEN
 #include <Eigen/Sparse>
 #include "nsessentials/data/Parallelization.h"
+#include "nsessentials/data/Serialization.h"
 
 namespace nse {
 	namespace math
@@ -313,6 +314,30 @@ namespace nse {
 			// Returns if a variable has been fixed by fixVariable()
 			bool isVariableFixed(int idx) const { return !variableEliminated.empty() && variableEliminated[idx]; }
 
+			// Saves the assembled energy (including fixed variables and constraints) to a sink (see Serialization.h).
+			template <typename Sink>
+			void saveToFile(Sink& f) const
+			{
+				nse::data::saveToFile(_A, f);
+				nse::data::saveToFile(_b, f);
+				nse::data::saveToFile(_c, f);
+				nse::data::saveToFile(variableEliminated, f);
+				nse::data::saveToFile(unknowns, f);
+				nse::data::saveToFile(nextConstraint, f);
+			}
+
+			// Loads an energy that has been saved with saveToFile(). Existing data is overridden.
+			template <typename Source>
+			void loadFromFile(Source& f)
+			{
+				nse::data::loadFromFile(_A, f);
+				nse::data::loadFromFile(_b, f);
+				nse::data::loadFromFile(_c, f);
+				nse::data::loadFromFile(variableEliminated, f);
+				nse::data::loadFromFile(unknowns, f);
+				nse::data::loadFromFile(nextConstraint, f);
+			}
+
 		private:
 			// components of this energy
 			MatrixType _A;
@@ -325,6 +350,11 @@ namespace nse {
 			int unknowns = 0;
 			int nextConstraint = 0;
 		};
+
+		template <int SubEnergies, typename Scalar, typename Sink>
+		void saveToFile(const QuadraticEnergy<SubEnergies, Scalar>& object, Sink& f) { object.saveToFile(f); }
+		template <int SubEnergies, typename Scalar, typename Source>
+		void loadFromFile(QuadraticEnergy<SubEnergies, Scalar>& object, Source& f) { object.loadFromFile(f); }
 	}
 }
 #endif
\ No newline at end of file
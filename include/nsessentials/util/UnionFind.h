@@ -2,7 +2,9 @@
 
 #include <vector>
 #include <cstddef>
+#include <cstdint>
 
+#include "nsessentials/data/Serialization.h"
 #include "nsessentials/NSELibrary.h"
 
 namespace nse
@@ -20,6 +22,28 @@ namespace nse
 			// Saves the entire structure to a file for later usage
 			NSE_EXPORT void SaveToFile(const char* filename) const;
 
+			// Saves the entire structure to an arbitrary sink (see Serialization.h). Uses the same format as SaveToFile().
+			template <typename Sink>
+			void Save(Sink& sink) const
+			{
+				uint64_t entries = size();
+				data::saveToFile(entries, sink);
+				data::saveArrayToFile(parentIndices.data(), parentIndices.size(), sink);
+				data::saveArrayToFile(ranks.data(), ranks.size(), sink);
+			}
+
+			// Loads the entire structure from an arbitrary source (see Serialization.h). Existing data in the structure is overridden.
+			template <typename Source>
+			void Load(Source& source)
+			{
+				uint64_t entries;
+				data::loadFromFile(entries, source);
+				parentIndices.resize((size_t)entries);
+				ranks.resize((size_t)entries);
+				data::loadArrayFromFile(parentIndices.data(), parentIndices.size(), source);
+				data::loadArrayFromFile(ranks.data(), ranks.size(), source);
+			}
+
 			// Returns the number of entries
 			NSE_EXPORT std::size_t size() const;
 
@@ -50,5 +74,10 @@ namespace nse
 			std::vector<index_t> parentIndices;
 			std::vector<unsigned int> ranks;
 		};
+
+		template <typename Sink>
+		void saveToFile(const UnionFind& object, Sink& sink) { object.Save(sink); }
+		template <typename Source>
+		void loadFromFile(UnionFind& object, Source& source) { object.Load(source); }
 	}
 }
\ No newline at end of file
@@ -0,0 +1,238 @@
+/*
+	This file is part of NSEssentials.
+
+	Use of this source code is granted via a BSD-style license, which can be found
+	in License.txt in the repository root.
+
+	@author Nico Schertler
+*/
+
+#include "nsessentials/data/AsyncWriter.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <iostream>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace nse::data;
+
+//Writes that are smaller than this are collected in the staging buffer
+static const size_t StagingSize = 1 << 20;
+
+//Flushes the file and forces its data to the disk.
+static bool syncFile(FILE* file)
+{
+#ifdef _WIN32
+	return fflush(file) == 0 && _commit(_fileno(file)) == 0;
+#else
+	return fflush(file) == 0 && fsync(fileno(file)) == 0;
+#endif
+}
+
+AsyncFileWriter::AsyncFileWriter(const std::string& path, size_t maxQueuedBytes)
+	: maxQueuedBytes(maxQueuedBytes), queuedBytes(0), closing(false)
+{
+	file = fopen(path.c_str(), "wb");
+	if (file == nullptr)
+		throw std::runtime_error("Cannot open file \"" + path + "\" for writing.");
+	worker = std::thread(&AsyncFileWriter::run, this);
+}
+
+AsyncFileWriter::~AsyncFileWriter()
+{
+	try
+	{
+		close();
+	}
+	catch (std::exception& e)
+	{
+		std::cerr << "Error while closing asynchronously written file: " << e.what() << std::endl;
+	}
+}
+
+void AsyncFileWriter::write(const void* data, size_t bytes)
+{
+	if (bytes >= StagingSize)
+	{
+		flushStaging();
+		//the copy is only made once it fits into the queue
+		reserveCapacity(bytes);
+		std::shared_ptr<std::vector<char>> copy;
+		try
+		{
+			copy = std::make_shared<std::vector<char>>(static_cast<const char*>(data), static_cast<const char*>(data) + bytes);
+		}
+		catch (...)
+		{
+			releaseCapacity(bytes);
+			throw;
+		}
+		pushReserved(std::shared_ptr<const void>(copy, copy->data()), bytes);
+		return;
+	}
+	if (staging.size() + bytes > StagingSize)
+		flushStaging();
+	staging.insert(staging.end(), static_cast<const char*>(data), static_cast<const char*>(data) + bytes);
+}
+
+void AsyncFileWriter::write(std::vector<char>&& buffer)
+{
+	flushStaging();
+	size_t bytes = buffer.size();
+	auto owner = std::make_shared<std::vector<char>>(std::move(buffer));
+	enqueue(std::shared_ptr<const void>(owner, owner->data()), bytes);
+}
+
+std::shared_future<void> AsyncFileWriter::fence()
+{
+	flushStaging();
+	Item item;
+	item.bytes = 0;
+	item.fence = std::make_shared<std::promise<void>>();
+	std::shared_future<void> future = item.fence->get_future().share();
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (closing)
+			throw std::runtime_error("The writer has already been closed.");
+		queue.push_back(item);
+	}
+	queueChanged.notify_all();
+	return future;
+}
+
+void AsyncFileWriter::close()
+{
+	if (file == nullptr)
+		return;
+
+	flushStaging();
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		closing = true;
+	}
+	queueChanged.notify_all();
+	worker.join();
+
+	bool durable = error ? false : syncFile(file);
+	bool closed = fclose(file) == 0;
+	file = nullptr;
+	if (error)
+		std::rethrow_exception(error);
+	if (!durable)
+		throw std::runtime_error("Cannot flush file to disk.");
+	if (!closed)
+		throw std::runtime_error("Cannot close file.");
+}
+
+void AsyncFileWriter::enqueue(std::shared_ptr<const void> data, size_t bytes)
+{
+	if (bytes == 0)
+		return;
+	reserveCapacity(bytes);
+	pushReserved(std::move(data), bytes);
+}
+
+void AsyncFileWriter::reserveCapacity(size_t bytes)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	if (error)
+		std::rethrow_exception(error);
+	if (closing)
+		throw std::runtime_error("The writer has already been closed.");
+	waitForCapacity(lock, bytes);
+	queuedBytes += bytes;
+}
+
+void AsyncFileWriter::releaseCapacity(size_t bytes)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		queuedBytes -= bytes;
+	}
+	queueChanged.notify_all();
+}
+
+void AsyncFileWriter::pushReserved(std::shared_ptr<const void> data, size_t bytes)
+{
+	Item item;
+	item.data = std::move(data);
+	item.bytes = bytes;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		queue.push_back(std::move(item));
+	}
+	queueChanged.notify_all();
+}
+
+void AsyncFileWriter::flushStaging()
+{
+	if (staging.empty())
+		return;
+	std::vector<char> buffer;
+	buffer.reserve(StagingSize);
+	std::swap(buffer, staging);
+	size_t bytes = buffer.size();
+	auto owner = std::make_shared<std::vector<char>>(std::move(buffer));
+	enqueue(std::shared_ptr<const void>(owner, owner->data()), bytes);
+}
+
+void AsyncFileWriter::waitForCapacity(std::unique_lock<std::mutex>& lock, size_t bytes)
+{
+	//a single item that exceeds the limit is accepted if nothing else is queued
+	queueChanged.wait(lock, [&]() { return queuedBytes == 0 || queuedBytes + bytes <= maxQueuedBytes || error; });
+	if (error)
+		std::rethrow_exception(error);
+}
+
+void AsyncFileWriter::run()
+{
+	while (true)
+	{
+		Item item;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			queueChanged.wait(lock, [&]() { return !queue.empty() || closing; });
+			if (queue.empty())
+				return;
+			item = std::move(queue.front());
+			queue.pop_front();
+		}
+
+		if (item.data && !error)
+		{
+			if (fwrite(item.data.get(), 1, item.bytes, file) != item.bytes)
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				error = std::make_exception_ptr(std::runtime_error("Cannot write to file."));
+			}
+		}
+
+		if (item.fence)
+		{
+			if (!error)
+			{
+				if (!syncFile(file))
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					error = std::make_exception_ptr(std::runtime_error("Cannot flush file to disk."));
+				}
+			}
+			if (error)
+				item.fence->set_exception(error);
+			else
+				item.fence->set_value();
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			queuedBytes -= item.bytes;
+			item.data.reset();
+		}
+		queueChanged.notify_all();
+	}
+}
@@ -0,0 +1,339 @@
+/*
+	This file is part of NSEssentials.
+
+	Use of this source code is granted via a BSD-style license, which can be found
+	in License.txt in the repository root.
+
+	@author Nico Schertler
+*/
+
+#include "nsessentials/data/Compression.h"
+#include "nsessentials/data/Parallelization.h"
+
+#include <cstring>
+#include <chrono>
+
+using namespace nse::data;
+
+//Block layout:
+//  uint64 uncompressed size, uint32 chunk size, uint32 shuffle type size, uint64 chunk count
+//  uint32 compressed size of every chunk (highest bit set if the chunk is stored uncompressed)
+//  chunk data
+//
+//Chunks use an LZ77 sequence format similar to LZ4. Every sequence consists of a token
+//(high nibble: literal count, low nibble: match length - MinMatch; 15 means that more length
+//bytes follow), the literals, a 16-bit match offset, and the additional match length bytes.
+//The last sequence only contains literals.
+
+static const uint32_t StoredFlag = 0x80000000u;
+static const size_t MinMatch = 4;
+static const size_t MaxOffset = 65535;
+static const int HashBits = 14;
+static const size_t BlockHeaderSize = 8 + 4 + 4 + 8;
+
+static uint32_t read32(const unsigned char* p)
+{
+	uint32_t v;
+	memcpy(&v, p, 4);
+	return v;
+}
+
+static uint32_t hashOf(uint32_t v)
+{
+	return (v * 2654435761u) >> (32 - HashBits);
+}
+
+static void writeLength(unsigned char*& out, size_t length)
+{
+	while (length >= 255)
+	{
+		*out++ = 255;
+		length -= 255;
+	}
+	*out++ = (unsigned char)length;
+}
+
+static size_t maxCompressedChunkSize(size_t bytes)
+{
+	return bytes + bytes / 255 + 16;
+}
+
+//Compresses a single chunk. Returns the compressed size.
+static size_t compressChunk(const unsigned char* src, size_t n, unsigned char* dst)
+{
+	std::vector<uint32_t> table(1 << HashBits, 0); //stores position + 1
+	unsigned char* out = dst;
+	size_t anchor = 0;
+	size_t ip = 0;
+
+	auto emitSequence = [&](size_t literalEnd, size_t offset, size_t matchLength)
+	{
+		size_t literals = literalEnd - anchor;
+		unsigned char* token = out++;
+		*token = (unsigned char)(std::min<size_t>(literals, 15) << 4);
+		if (literals >= 15)
+			writeLength(out, literals - 15);
+		memcpy(out, src + anchor, literals);
+		out += literals;
+		if (matchLength == 0)
+			return;
+		*out++ = (unsigned char)(offset & 0xff);
+		*out++ = (unsigned char)(offset >> 8);
+		size_t m = matchLength - MinMatch;
+		*token |= (unsigned char)std::min<size_t>(m, 15);
+		if (m >= 15)
+			writeLength(out, m - 15);
+	};
+
+	//the last bytes are always emitted as literals
+	const size_t searchLimit = n > 12 ? n - 12 : 0;
+	while (ip < searchLimit)
+	{
+		uint32_t sequence = read32(src + ip);
+		uint32_t h = hashOf(sequence);
+		size_t candidate = table[h];
+		table[h] = (uint32_t)(ip + 1);
+		if (candidate != 0 && ip - (candidate - 1) <= MaxOffset && read32(src + candidate - 1) == sequence)
+		{
+			size_t ref = candidate - 1;
+			size_t length = MinMatch;
+			const size_t maxLength = n - 5 - ip;
+			while (length < maxLength && src[ref + length] == src[ip + length])
+				++length;
+			emitSequence(ip, ip - ref, length);
+			ip += length;
+			anchor = ip;
+		}
+		else
+			//skip faster through incompressible data
+			ip += 1 + ((ip - anchor) >> 6);
+	}
+	emitSequence(n, 0, 0);
+	return out - dst;
+}
+
+static void decompressChunk(const unsigned char* src, size_t n, unsigned char* dst, size_t outBytes)
+{
+	const unsigned char* in = src;
+	const unsigned char* inEnd = src + n;
+	unsigned char* out = dst;
+	unsigned char* outEnd = dst + outBytes;
+	auto corrupt = []() { throw std::runtime_error("Compressed data is corrupt."); };
+
+	auto readLength = [&](size_t length)
+	{
+		if (length == 15)
+		{
+			unsigned char b;
+			do
+			{
+				if (in >= inEnd)
+					corrupt();
+				b = *in++;
+				length += b;
+			} while (b == 255);
+		}
+		return length;
+	};
+
+	while (in < inEnd)
+	{
+		unsigned char token = *in++;
+		size_t literals = readLength(token >> 4);
+		if (literals > (size_t)(inEnd - in) || literals > (size_t)(outEnd - out))
+			corrupt();
+		memcpy(out, in, literals);
+		in += literals;
+		out += literals;
+		if (in == inEnd)
+			break;
+
+		if (inEnd - in < 2)
+			corrupt();
+		size_t offset = in[0] | (in[1] << 8);
+		in += 2;
+		size_t length = readLength(token & 15) + MinMatch;
+		if (offset == 0 || offset > (size_t)(out - dst) || length > (size_t)(outEnd - out))
+			corrupt();
+		if (offset == 1)
+		{
+			memset(out, out[-1], length);
+			out += length;
+		}
+		else
+		{
+			//overlapping matches repeat the last offset bytes
+			while (length > 0)
+			{
+				size_t n = std::min(offset, length);
+				memcpy(out, out - offset, n);
+				out += n;
+				length -= n;
+			}
+		}
+	}
+	if (out != outEnd)
+		corrupt();
+}
+
+static void shuffle(const unsigned char* src, size_t n, size_t typeSize, unsigned char* dst)
+{
+	size_t elements = n / typeSize;
+	for (size_t i = 0; i < elements; ++i)
+		for (size_t b = 0; b < typeSize; ++b)
+			dst[b * elements + i] = src[i * typeSize + b];
+	memcpy(dst + elements * typeSize, src + elements * typeSize, n - elements * typeSize);
+}
+
+static void unshuffle(const unsigned char* src, size_t n, size_t typeSize, unsigned char* dst)
+{
+	size_t elements = n / typeSize;
+	for (size_t b = 0; b < typeSize; ++b)
+		for (size_t i = 0; i < elements; ++i)
+			dst[i * typeSize + b] = src[b * elements + i];
+	memcpy(dst + elements * typeSize, src + elements * typeSize, n - elements * typeSize);
+}
+
+void nse::data::compress(const void* data, size_t bytes, std::vector<char>& out, const CompressionOptions& options, CompressionStats* stats)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	uint32_t typeSize = std::max(1u, options.shuffleTypeSize);
+	//chunks must contain whole elements
+	uint32_t chunkSize = std::max(typeSize, options.chunkSize / typeSize * typeSize);
+	if (chunkSize >= StoredFlag)
+		throw std::runtime_error("The compression chunk size is too large.");
+	uint64_t chunkCount = (bytes + chunkSize - 1) / chunkSize;
+
+	std::vector<std::vector<unsigned char>> chunks((size_t)chunkCount);
+	std::vector<uint32_t> chunkSizes((size_t)chunkCount);
+	auto src = static_cast<const unsigned char*>(data);
+	parallel_for_index((size_t)chunkCount, [&](size_t i)
+	{
+		size_t offset = i * chunkSize;
+		size_t n = std::min<size_t>(chunkSize, bytes - offset);
+		const unsigned char* input = src + offset;
+		std::vector<unsigned char> shuffled;
+		if (typeSize > 1)
+		{
+			shuffled.resize(n);
+			shuffle(input, n, typeSize, shuffled.data());
+			input = shuffled.data();
+		}
+		auto& chunk = chunks[i];
+		chunk.resize(maxCompressedChunkSize(n));
+		size_t compressedSize = compressChunk(input, n, chunk.data());
+		if (compressedSize >= n)
+		{
+			//store incompressible data as is
+			memcpy(chunk.data(), src + offset, n);
+			chunk.resize(n);
+			chunkSizes[i] = (uint32_t)n | StoredFlag;
+		}
+		else
+		{
+			chunk.resize(compressedSize);
+			chunkSizes[i] = (uint32_t)compressedSize;
+		}
+	}, options.threads);
+
+	size_t total = BlockHeaderSize + chunkSizes.size() * sizeof(uint32_t);
+	for (auto& c : chunks)
+		total += c.size();
+	size_t outOffset = out.size();
+	out.resize(outOffset + total);
+	char* p = out.data() + outOffset;
+	uint64_t uncompressed = bytes;
+	memcpy(p, &uncompressed, 8); p += 8;
+	memcpy(p, &chunkSize, 4); p += 4;
+	memcpy(p, &typeSize, 4); p += 4;
+	memcpy(p, &chunkCount, 8); p += 8;
+	if (chunkCount > 0)
+	{
+		memcpy(p, chunkSizes.data(), chunkSizes.size() * sizeof(uint32_t));
+		p += chunkSizes.size() * sizeof(uint32_t);
+	}
+	for (auto& c : chunks)
+	{
+		if (!c.empty())
+			memcpy(p, c.data(), c.size());
+		p += c.size();
+	}
+
+	if (stats)
+	{
+		stats->uncompressedBytes += bytes;
+		stats->compressedBytes += total;
+		stats->seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+uint64_t nse::data::uncompressedSize(const char* compressed, size_t compressedBytes)
+{
+	if (compressedBytes < BlockHeaderSize)
+		throw std::runtime_error("Compressed data is corrupt.");
+	uint64_t size;
+	memcpy(&size, compressed, 8);
+	return size;
+}
+
+size_t nse::data::decompress(const char* compressed, size_t compressedBytes, void* out, size_t outBytes, unsigned int threads, CompressionStats* stats)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	uint64_t bytes = uncompressedSize(compressed, compressedBytes);
+	uint32_t chunkSize, typeSize;
+	uint64_t chunkCount;
+	memcpy(&chunkSize, compressed + 8, 4);
+	memcpy(&typeSize, compressed + 12, 4);
+	memcpy(&chunkCount, compressed + 16, 8);
+	if (bytes > outBytes)
+		throw std::runtime_error("The output buffer is too small for the compressed data.");
+	if (chunkSize == 0 || typeSize == 0 || chunkCount != (bytes + chunkSize - 1) / chunkSize
+		|| chunkCount > (compressedBytes - BlockHeaderSize) / sizeof(uint32_t))
+		throw std::runtime_error("Compressed data is corrupt.");
+
+	std::vector<uint32_t> chunkSizes((size_t)chunkCount);
+	if (chunkCount > 0)
+		memcpy(chunkSizes.data(), compressed + BlockHeaderSize, chunkSizes.size() * sizeof(uint32_t));
+	std::vector<size_t> chunkOffsets((size_t)chunkCount);
+	size_t offset = BlockHeaderSize + chunkSizes.size() * sizeof(uint32_t);
+	for (size_t i = 0; i < chunkSizes.size(); ++i)
+	{
+		chunkOffsets[i] = offset;
+		offset += chunkSizes[i] & ~StoredFlag;
+	}
+	if (offset > compressedBytes)
+		throw std::runtime_error("Compressed data is corrupt.");
+
+	auto dst = static_cast<unsigned char*>(out);
+	auto src = reinterpret_cast<const unsigned char*>(compressed);
+	parallel_for_index((size_t)chunkCount, [&](size_t i)
+	{
+		size_t outOffset = i * (size_t)chunkSize;
+		size_t n = std::min<size_t>(chunkSize, (size_t)bytes - outOffset);
+		size_t inSize = chunkSizes[i] & ~StoredFlag;
+		if (chunkSizes[i] & StoredFlag)
+		{
+			if (inSize != n)
+				throw std::runtime_error("Compressed data is corrupt.");
+			memcpy(dst + outOffset, src + chunkOffsets[i], n);
+		}
+		else if (typeSize > 1)
+		{
+			std::vector<unsigned char> shuffled(n);
+			decompressChunk(src + chunkOffsets[i], inSize, shuffled.data(), n);
+			unshuffle(shuffled.data(), n, typeSize, dst + outOffset);
+		}
+		else
+			decompressChunk(src + chunkOffsets[i], inSize, dst + outOffset, n);
+	}, threads);
+
+	if (stats)
+	{
+		stats->uncompressedBytes += bytes;
+		stats->compressedBytes += offset;
+		stats->seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+	return offset;
+}
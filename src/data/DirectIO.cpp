@@ -0,0 +1,368 @@
+/*
+	This file is part of NSEssentials.
+
+	Use of this source code is granted via a BSD-style license, which can be found
+	in License.txt in the repository root.
+
+	@author Nico Schertler
+*/
+
+#include "nsessentials/data/DirectIO.h"
+#include "nsessentials/data/ParallelFileIO.h"
+
+#include <stdexcept>
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <fcntl.h>
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <io.h>
+#include <malloc.h>
+#include <sys/stat.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace nse::data;
+
+//Threads that execute the transfers of one sink or source. They are started with the stream, so
+//submitting a transfer does not create a thread. Without threads, transfers run in the calling thread.
+class nse::data::detail::TransferThreads
+{
+public:
+	TransferThreads(unsigned int count)
+		: stopping(false)
+	{
+		for (unsigned int i = 0; i < count; ++i)
+			threads.emplace_back(&TransferThreads::run, this);
+	}
+
+	//Finishes all submitted transfers.
+	~TransferThreads()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		available.notify_all();
+		for (auto& t : threads)
+			t.join();
+	}
+
+	template <typename Result, typename Func>
+	std::future<Result> submit(const Func& f)
+	{
+		auto task = std::make_shared<std::packaged_task<Result()>>(f);
+		std::future<Result> result = task->get_future();
+		if (threads.empty())
+		{
+			(*task)();
+			return result;
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			queue.push_back([task]() { (*task)(); });
+		}
+		available.notify_one();
+		return result;
+	}
+
+private:
+	void run()
+	{
+		while (true)
+		{
+			std::function<void()> task;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				available.wait(lock, [this]() { return stopping || !queue.empty(); });
+				if (queue.empty())
+					return;
+				task = std::move(queue.front());
+				queue.pop_front();
+			}
+			task();
+		}
+	}
+
+	std::vector<std::thread> threads;
+	std::deque<std::function<void()>> queue;
+	std::mutex mutex;
+	std::condition_variable available;
+	bool stopping;
+};
+
+static std::shared_ptr<char> allocateAligned(size_t bytes, size_t alignment)
+{
+#ifdef _WIN32
+	char* p = static_cast<char*>(_aligned_malloc(bytes, alignment));
+	if (p == nullptr)
+		throw std::bad_alloc();
+	return std::shared_ptr<char>(p, [](char* p) { _aligned_free(p); });
+#else
+	void* p;
+	if (posix_memalign(&p, alignment, bytes) != 0)
+		throw std::bad_alloc();
+	return std::shared_ptr<char>(static_cast<char*>(p), [](char* p) { free(p); });
+#endif
+}
+
+//Checks the options and rounds the buffer size up to a multiple of the alignment.
+static DirectIOOptions validate(DirectIOOptions options)
+{
+	if (options.alignment == 0 || (options.alignment & (options.alignment - 1)) != 0)
+		throw std::runtime_error("The direct I/O alignment must be a power of two.");
+	options.bufferSize = std::max(options.alignment, (options.bufferSize + options.alignment - 1) / options.alignment * options.alignment);
+	options.queueDepth = std::max(1u, options.queueDepth);
+	return options;
+}
+
+//Opens a file with direct I/O if possible. Returns a negative value on failure.
+static int openDirect(const std::string& path, bool write, bool& direct)
+{
+#ifdef _WIN32
+	HANDLE handle = CreateFileA(path.c_str(), write ? GENERIC_WRITE : GENERIC_READ, write ? 0 : FILE_SHARE_READ, nullptr,
+		write ? CREATE_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_NO_BUFFERING, nullptr);
+	if (handle != INVALID_HANDLE_VALUE)
+	{
+		direct = true;
+		return _open_osfhandle((intptr_t)handle, write ? 0 : _O_RDONLY);
+	}
+	direct = false;
+	if (write)
+		return _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+	return _open(path.c_str(), _O_RDONLY | _O_BINARY);
+#else
+	int flags = write ? (O_WRONLY | O_CREAT | O_TRUNC) : O_RDONLY;
+	direct = false;
+#ifdef O_DIRECT
+	int fd = open(path.c_str(), flags | O_DIRECT, 0644);
+	if (fd >= 0)
+	{
+		direct = true;
+		return fd;
+	}
+	//file systems without direct I/O support (e.g., tmpfs) report EINVAL
+	if (errno != EINVAL)
+		return fd;
+#endif
+	int result = open(path.c_str(), flags, 0644);
+#ifdef F_NOCACHE
+	if (result >= 0)
+		direct = fcntl(result, F_NOCACHE, 1) == 0;
+#endif
+	return result;
+#endif
+}
+
+static void closeDescriptor(int fd)
+{
+#ifdef _WIN32
+	_close(fd);
+#else
+	close(fd);
+#endif
+}
+
+DirectFileSink::DirectFileSink(const std::string& path, const DirectIOOptions& options)
+	: path(path), options(validate(options)), current(0), filled(0), offset(0)
+{
+	fd = openDirect(path, true, direct);
+	if (fd < 0)
+		throw std::runtime_error("Cannot open file \"" + path + "\" for writing.");
+	for (unsigned int i = 0; i < this->options.queueDepth; ++i)
+		buffers.push_back(allocateAligned(this->options.bufferSize, this->options.alignment));
+	pending.resize(buffers.size());
+	//the caller fills one buffer while the others are in flight
+	threads.reset(new detail::TransferThreads(this->options.queueDepth - 1));
+}
+
+DirectFileSink::~DirectFileSink()
+{
+	try
+	{
+		close();
+	}
+	catch (std::exception& e)
+	{
+		std::cerr << "Error while closing file \"" << path << "\": " << e.what() << std::endl;
+	}
+}
+
+void DirectFileSink::write(const void* data, size_t bytes)
+{
+	if (fd < 0)
+		throw std::runtime_error("The file \"" + path + "\" has already been closed.");
+	const char* p = static_cast<const char*>(data);
+	while (bytes > 0)
+	{
+		size_t n = std::min(bytes, options.bufferSize - filled);
+		std::memcpy(buffers[current].get() + filled, p, n);
+		filled += n;
+		p += n;
+		bytes -= n;
+		if (filled == options.bufferSize)
+			submit(filled);
+	}
+}
+
+void DirectFileSink::submit(size_t bytes)
+{
+	std::shared_ptr<char> buffer = buffers[current];
+	uint64_t at = offset;
+	int fd = this->fd;
+	pending[current] = threads->submit<void>([fd, buffer, bytes, at]()
+	{
+		positionedWrite(fd, buffer.get(), bytes, at);
+	});
+	offset += bytes;
+	filled = 0;
+	current = (current + 1) % buffers.size();
+	//wait until the next buffer is available
+	if (pending[current].valid())
+		pending[current].get();
+}
+
+void DirectFileSink::waitForAll()
+{
+	std::exception_ptr error;
+	for (auto& p : pending)
+	{
+		if (!p.valid())
+			continue;
+		try
+		{
+			p.get();
+		}
+		catch (...)
+		{
+			if (!error)
+				error = std::current_exception();
+		}
+	}
+	if (error)
+		std::rethrow_exception(error);
+}
+
+void DirectFileSink::close()
+{
+	if (fd < 0)
+		return;
+
+	int fd = this->fd;
+	this->fd = -1;
+	try
+	{
+		waitForAll();
+
+		//direct I/O can only write whole blocks
+		size_t aligned = direct ? filled / options.alignment * options.alignment : filled;
+		positionedWrite(fd, buffers[current].get(), aligned, offset);
+		closeDescriptor(fd);
+		fd = -1;
+
+		size_t tail = filled - aligned;
+		if (tail > 0)
+		{
+#ifdef _WIN32
+			int tailFd = _open(path.c_str(), _O_WRONLY | _O_BINARY);
+#else
+			int tailFd = open(path.c_str(), O_WRONLY);
+#endif
+			if (tailFd < 0)
+				throw std::runtime_error("Cannot open file \"" + path + "\" for writing.");
+			try
+			{
+				positionedWrite(tailFd, buffers[current].get() + aligned, tail, offset + aligned);
+			}
+			catch (...)
+			{
+				closeDescriptor(tailFd);
+				throw;
+			}
+			closeDescriptor(tailFd);
+		}
+		offset += filled;
+		filled = 0;
+	}
+	catch (...)
+	{
+		if (fd >= 0)
+			closeDescriptor(fd);
+		throw;
+	}
+}
+
+DirectFileSource::DirectFileSource(const std::string& path, const DirectIOOptions& options)
+	: options(validate(options)), current(0), hasBuffer(false), begin(0), end(0), prefetchOffset(0), endOfFile(false)
+{
+	fd = openDirect(path, false, direct);
+	if (fd < 0)
+		throw std::runtime_error("Cannot open file \"" + path + "\".");
+	for (unsigned int i = 0; i < this->options.queueDepth; ++i)
+		buffers.push_back(allocateAligned(this->options.bufferSize, this->options.alignment));
+	pending.resize(buffers.size());
+	threads.reset(new detail::TransferThreads(this->options.queueDepth - 1));
+	for (size_t i = 0; i < buffers.size(); ++i)
+		prefetch(i);
+}
+
+DirectFileSource::~DirectFileSource()
+{
+	for (auto& p : pending)
+		if (p.valid())
+			p.wait();
+	closeDescriptor(fd);
+}
+
+void DirectFileSource::prefetch(size_t buffer)
+{
+	std::shared_ptr<char> b = buffers[buffer];
+	size_t bytes = options.bufferSize;
+	uint64_t at = prefetchOffset;
+	int fd = this->fd;
+	pending[buffer] = threads->submit<size_t>([fd, b, bytes, at]()
+	{
+		return positionedRead(fd, b.get(), bytes, at);
+	});
+	prefetchOffset += bytes;
+}
+
+void DirectFileSource::read(void* data, size_t bytes)
+{
+	char* p = static_cast<char*>(data);
+	while (bytes > 0)
+	{
+		if (begin == end)
+		{
+			if (endOfFile)
+				throw std::runtime_error("Cannot read enough data from file");
+			if (hasBuffer)
+			{
+				prefetch(current);
+				current = (current + 1) % buffers.size();
+			}
+			begin = 0;
+			end = pending[current].get();
+			hasBuffer = true;
+			//a short transfer ends at the end of the file
+			if (end < options.bufferSize)
+				endOfFile = true;
+			continue;
+		}
+		size_t n = std::min(bytes, end - begin);
+		std::memcpy(p, buffers[current].get() + begin, n);
+		begin += n;
+		p += n;
+		bytes -= n;
+	}
+}
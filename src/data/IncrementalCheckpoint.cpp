@@ -0,0 +1,310 @@
+/*
+	This file is part of NSEssentials.
+
+	Use of this source code is granted via a BSD-style license, which can be found
+	in License.txt in the repository root.
+
+	@author Nico Schertler
+*/
+
+#include "nsessentials/data/IncrementalCheckpoint.h"
+#include "nsessentials/data/Hash.h"
+#include "nsessentials/data/Parallelization.h"
+
+#include <stdio.h>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
+using namespace nse::data;
+
+const char CheckpointMagic[8] = { 'N', 'S', 'E', 'C', 'K', 'P', 'T', '\0' };
+const char ManifestMagic[8] = { 'N', 'S', 'E', 'C', 'K', 'M', 'F', '\0' };
+const uint32_t CheckpointVersion = 2; //version 2 stores 128-bit chunk hashes
+
+struct GenerationHeader
+{
+	uint64_t generation;
+	uint64_t payloadBytes;
+	uint64_t chunkSize;
+	std::vector<Hash128> hashes;
+};
+
+static std::string generationPath(const std::string& path, uint64_t generation)
+{
+	return path + "." + std::to_string(generation);
+}
+
+static uint64_t chunkBytes(uint64_t payloadBytes, uint64_t chunkSize, uint64_t chunk)
+{
+	uint64_t begin = chunk * chunkSize;
+	return begin >= payloadBytes ? 0 : std::min(chunkSize, payloadBytes - begin);
+}
+
+//Flushes the file and forces its data to the disk.
+static bool syncFile(FILE* file)
+{
+#ifdef _WIN32
+	return fflush(file) == 0 && _commit(_fileno(file)) == 0;
+#else
+	return fflush(file) == 0 && fsync(fileno(file)) == 0;
+#endif
+}
+
+//Forces a rename in the directory of the given file to the disk. Windows has no equivalent.
+static bool syncDirectoryOf(const std::string& path)
+{
+#ifdef _WIN32
+	return true;
+#else
+	size_t slash = path.find_last_of('/');
+	std::string dir = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+	int fd = open(dir.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	bool synced = fsync(fd) == 0;
+	return close(fd) == 0 && synced;
+#endif
+}
+
+//Checks for write errors, forces the file to the disk, and closes it.
+static void syncAndClose(FILE* f, const std::string& path)
+{
+	bool failed = ferror(f) != 0 || !syncFile(f);
+	if (fclose(f) != 0 || failed)
+		throw std::runtime_error("Cannot write file \"" + path + "\".");
+}
+
+static void checkMagic(FILE* f, const char* magic, const std::string& path)
+{
+	char m[8];
+	uint32_t version, reserved;
+	if (fread(m, 1, 8, f) != 8 || memcmp(m, magic, 8) != 0)
+		throw std::runtime_error("\"" + path + "\" is not a checkpoint file.");
+	loadFromFile(version, f);
+	loadFromFile(reserved, f);
+	if (version != CheckpointVersion)
+		throw std::runtime_error("\"" + path + "\" has an unsupported checkpoint version.");
+}
+
+static void writeMagic(FILE* f, const char* magic)
+{
+	fwrite(magic, 1, 8, f);
+	uint32_t reserved = 0;
+	saveToFile(CheckpointVersion, f);
+	saveToFile(reserved, f);
+}
+
+//Returns false if there is no manifest.
+static bool readManifest(const std::string& path, uint64_t& base, uint64_t& last)
+{
+	FILE* f = fopen(path.c_str(), "rb");
+	if (f == nullptr)
+		return false;
+	try
+	{
+		checkMagic(f, ManifestMagic, path);
+		loadFromFile(base, f);
+		loadFromFile(last, f);
+	}
+	catch (...)
+	{
+		fclose(f);
+		throw;
+	}
+	fclose(f);
+	return true;
+}
+
+//Writes the manifest to a temporary file and replaces the old one such that readers never see a
+//partially written manifest. The manifest and the rename are forced to the disk before returning, so
+//a crash cannot leave a manifest that references a generation that is not durable.
+static void writeManifest(const std::string& path, uint64_t base, uint64_t last)
+{
+	std::string tmp = path + ".tmp";
+	FILE* f = fopen(tmp.c_str(), "wb");
+	if (f == nullptr)
+		throw std::runtime_error("Cannot open file \"" + tmp + "\" for writing.");
+	writeMagic(f, ManifestMagic);
+	saveToFile(base, f);
+	saveToFile(last, f);
+	syncAndClose(f, tmp);
+#ifdef _WIN32
+	remove(path.c_str());
+#endif
+	if (rename(tmp.c_str(), path.c_str()) != 0)
+		throw std::runtime_error("Cannot replace file \"" + path + "\".");
+	if (!syncDirectoryOf(path))
+		throw std::runtime_error("Cannot write the directory of file \"" + path + "\".");
+}
+
+static void readGenerationHeader(FILE* f, const std::string& path, GenerationHeader& header)
+{
+	checkMagic(f, CheckpointMagic, path);
+	loadFromFile(header.generation, f);
+	loadFromFile(header.payloadBytes, f);
+	loadFromFile(header.chunkSize, f);
+	loadFromFile(header.hashes, f);
+	if (header.chunkSize == 0 || header.hashes.size() != (header.payloadBytes + header.chunkSize - 1) / header.chunkSize)
+		throw std::runtime_error("\"" + path + "\" has an invalid header.");
+}
+
+static void hashChunks(const char* data, uint64_t bytes, uint64_t chunkSize, std::vector<Hash128>& hashes, unsigned int threads)
+{
+	hashes.resize((size_t)((bytes + chunkSize - 1) / chunkSize));
+	parallel_for_index(hashes.size(), [&](size_t i)
+	{
+		hashes[i] = hashBytes128(data + i * chunkSize, (size_t)chunkBytes(bytes, chunkSize, i));
+	}, threads);
+}
+
+IncrementalCheckpointWriter::IncrementalCheckpointWriter(const std::string& path, const IncrementalCheckpointOptions& options)
+	: path(path), options(options), baseGeneration(0), lastGeneration(0), lastPayloadBytes(0), forceBase(false)
+{
+	if (options.chunkSize == 0)
+		throw std::runtime_error("The chunk size must be positive.");
+
+	if (!readManifest(path, baseGeneration, lastGeneration))
+		return;
+
+	//continue the existing chain with the hashes of the last generation
+	std::string lastPath = generationPath(path, lastGeneration);
+	FILE* f = fopen(lastPath.c_str(), "rb");
+	if (f == nullptr)
+		throw std::runtime_error("Cannot open file \"" + lastPath + "\".");
+	GenerationHeader header;
+	try
+	{
+		readGenerationHeader(f, lastPath, header);
+	}
+	catch (...)
+	{
+		fclose(f);
+		throw;
+	}
+	fclose(f);
+
+	lastPayloadBytes = header.payloadBytes;
+	chunkHashes = std::move(header.hashes);
+	if (header.chunkSize != options.chunkSize)
+		forceBase = true;
+}
+
+IncrementalCheckpointStats IncrementalCheckpointWriter::commit(const void* data, size_t bytes)
+{
+	const char* p = static_cast<const char*>(data);
+	uint64_t chunkSize = options.chunkSize;
+
+	IncrementalCheckpointStats stats;
+	stats.generation = lastGeneration + 1;
+	stats.payloadBytes = bytes;
+	stats.isBase = forceBase || lastGeneration == 0 || lastGeneration - baseGeneration >= options.maxChainLength;
+
+	std::vector<Hash128> hashes;
+	hashChunks(p, bytes, chunkSize, hashes, options.threads);
+	stats.totalChunks = hashes.size();
+
+	std::vector<uint64_t> dirty;
+	for (uint64_t i = 0; i < hashes.size(); ++i)
+	{
+		if (stats.isBase || i >= chunkHashes.size() || chunkHashes[i] != hashes[i]
+			|| chunkBytes(lastPayloadBytes, chunkSize, i) != chunkBytes(bytes, chunkSize, i))
+			dirty.push_back(i);
+	}
+	stats.dirtyChunks = dirty.size();
+
+	std::string filePath = generationPath(path, stats.generation);
+	FILE* f = fopen(filePath.c_str(), "wb");
+	if (f == nullptr)
+		throw std::runtime_error("Cannot open file \"" + filePath + "\" for writing.");
+	writeMagic(f, CheckpointMagic);
+	saveToFile(stats.generation, f);
+	saveToFile(stats.payloadBytes, f);
+	saveToFile(chunkSize, f);
+	saveToFile(hashes, f);
+	uint64_t dirtyCount = dirty.size();
+	saveToFile(dirtyCount, f);
+	for (uint64_t i : dirty)
+	{
+		uint64_t n = chunkBytes(bytes, chunkSize, i);
+		saveToFile(i, f);
+		fwrite(p + i * chunkSize, 1, (size_t)n, f);
+		stats.writtenBytes += n;
+	}
+	//the generation has to be durable before the manifest references it
+	syncAndClose(f, filePath);
+
+	uint64_t oldBase = baseGeneration;
+	uint64_t oldLast = lastGeneration;
+	if (stats.isBase)
+		baseGeneration = stats.generation;
+	writeManifest(path, baseGeneration, stats.generation);
+
+	//the previous chain is not referenced anymore after compaction
+	if (stats.isBase && oldLast != 0)
+		for (uint64_t g = oldBase; g <= oldLast; ++g)
+			remove(generationPath(path, g).c_str());
+
+	lastGeneration = stats.generation;
+	lastPayloadBytes = bytes;
+	chunkHashes = std::move(hashes);
+	forceBase = false;
+	return stats;
+}
+
+void nse::data::loadCheckpointPayload(const std::string& path, std::vector<char>& payload)
+{
+	uint64_t base, last;
+	if (!readManifest(path, base, last))
+		throw std::runtime_error("Cannot open file \"" + path + "\".");
+
+	GenerationHeader header;
+	for (uint64_t g = base; g <= last; ++g)
+	{
+		std::string filePath = generationPath(path, g);
+		FILE* f = fopen(filePath.c_str(), "rb");
+		if (f == nullptr)
+			throw std::runtime_error("Cannot open file \"" + filePath + "\".");
+		try
+		{
+			readGenerationHeader(f, filePath, header);
+			if (header.generation != g)
+				throw std::runtime_error("\"" + filePath + "\" does not belong to the checkpoint chain.");
+			payload.resize((size_t)header.payloadBytes);
+
+			uint64_t dirtyCount;
+			loadFromFile(dirtyCount, f);
+			if (g == base && dirtyCount != header.hashes.size())
+				throw std::runtime_error("\"" + filePath + "\" is not a complete base checkpoint.");
+			for (uint64_t j = 0; j < dirtyCount; ++j)
+			{
+				uint64_t i;
+				loadFromFile(i, f);
+				if (i >= header.hashes.size())
+					throw std::runtime_error("\"" + filePath + "\" contains an invalid chunk.");
+				size_t n = (size_t)chunkBytes(header.payloadBytes, header.chunkSize, i);
+				if (fread(payload.data() + i * header.chunkSize, 1, n, f) != n)
+					throw std::runtime_error("Cannot read enough data from file");
+			}
+		}
+		catch (...)
+		{
+			fclose(f);
+			throw;
+		}
+		fclose(f);
+	}
+
+	//the reassembled payload must match the hashes of the last generation
+	std::vector<Hash128> hashes;
+	hashChunks(payload.data(), payload.size(), header.chunkSize, hashes, 0);
+	if (hashes != header.hashes)
+		throw std::runtime_error("The checkpoint chain at \"" + path + "\" is inconsistent.");
+}
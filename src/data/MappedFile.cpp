@@ -0,0 +1,128 @@
+/*
+	This file is part of NSEssentials.
+
+	Use of this source code is granted via a BSD-style license, which can be found
+	in License.txt in the repository root.
+
+	@author Nico Schertler
+*/
+
+#include "nsessentials/data/MappedFile.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace nse::data;
+
+MappedFile::MappedFile()
+	: _data(nullptr), _size(0)
+#ifdef _WIN32
+	, fileHandle(INVALID_HANDLE_VALUE), mappingHandle(nullptr)
+#endif
+{ }
+
+MappedFile::MappedFile(const std::string& path)
+	: MappedFile()
+{
+	open(path);
+}
+
+MappedFile::MappedFile(MappedFile&& other)
+	: MappedFile()
+{
+	*this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other)
+{
+	close();
+	std::swap(_data, other._data);
+	std::swap(_size, other._size);
+#ifdef _WIN32
+	std::swap(fileHandle, other.fileHandle);
+	std::swap(mappingHandle, other.mappingHandle);
+#endif
+	return *this;
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+void MappedFile::open(const std::string& path)
+{
+	close();
+
+#ifdef _WIN32
+	fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (fileHandle == INVALID_HANDLE_VALUE)
+		throw std::runtime_error("Cannot open file \"" + path + "\".");
+	LARGE_INTEGER fileSize;
+	GetFileSizeEx(fileHandle, &fileSize);
+	_size = (size_t)fileSize.QuadPart;
+	if (_size == 0)
+		return;
+	mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mappingHandle == nullptr)
+	{
+		close();
+		throw std::runtime_error("Cannot map file \"" + path + "\".");
+	}
+	_data = static_cast<const char*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+	if (_data == nullptr)
+	{
+		close();
+		throw std::runtime_error("Cannot map file \"" + path + "\".");
+	}
+#else
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		throw std::runtime_error("Cannot open file \"" + path + "\".");
+	struct stat s;
+	if (fstat(fd, &s) != 0)
+	{
+		::close(fd);
+		throw std::runtime_error("Cannot find properties of file \"" + path + "\".");
+	}
+	_size = (size_t)s.st_size;
+	if (_size > 0)
+	{
+		void* mapping = mmap(nullptr, _size, PROT_READ, MAP_SHARED, fd, 0);
+		if (mapping == MAP_FAILED)
+		{
+			::close(fd);
+			_size = 0;
+			throw std::runtime_error("Cannot map file \"" + path + "\".");
+		}
+		_data = static_cast<const char*>(mapping);
+	}
+	//the mapping stays valid after closing the descriptor
+	::close(fd);
+#endif
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+	if (_data != nullptr)
+		UnmapViewOfFile(_data);
+	if (mappingHandle != nullptr)
+		CloseHandle(mappingHandle);
+	if (fileHandle != INVALID_HANDLE_VALUE)
+		CloseHandle(fileHandle);
+	mappingHandle = nullptr;
+	fileHandle = INVALID_HANDLE_VALUE;
+#else
+	if (_data != nullptr)
+		munmap(const_cast<char*>(_data), _size);
+#endif
+	_data = nullptr;
+	_size = 0;
+}
@@ -0,0 +1,265 @@
+/*
+	This file is part of NSEssentials.
+
+	Use of this source code is granted via a BSD-style license, which can be found
+	in License.txt in the repository root.
+
+	@author Nico Schertler
+*/
+
+#include "nsessentials/data/ParallelFileIO.h"
+#include "nsessentials/data/Parallelization.h"
+
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <iostream>
+#include <fcntl.h>
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace nse::data;
+
+//Maximum number of bytes that are passed to a single system call
+static const size_t MaxTransfer = 1 << 30;
+
+void nse::data::positionedWrite(int fd, const void* data, size_t bytes, uint64_t offset)
+{
+	const char* p = static_cast<const char*>(data);
+	while (bytes > 0)
+	{
+		size_t n = std::min(bytes, MaxTransfer);
+#ifdef _WIN32
+		OVERLAPPED overlapped = {};
+		overlapped.Offset = (DWORD)offset;
+		overlapped.OffsetHigh = (DWORD)(offset >> 32);
+		DWORD written;
+		if (!WriteFile((HANDLE)_get_osfhandle(fd), p, (DWORD)n, &written, &overlapped))
+			throw std::runtime_error("Cannot write to file.");
+#else
+		auto written = pwrite(fd, p, n, (off_t)offset);
+		if (written < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			throw std::runtime_error("Cannot write to file.");
+		}
+#endif
+		p += written;
+		bytes -= written;
+		offset += written;
+	}
+}
+
+size_t nse::data::positionedRead(int fd, void* data, size_t bytes, uint64_t offset)
+{
+	char* p = static_cast<char*>(data);
+	size_t total = 0;
+	while (bytes > 0)
+	{
+		size_t n = std::min(bytes, MaxTransfer);
+#ifdef _WIN32
+		OVERLAPPED overlapped = {};
+		overlapped.Offset = (DWORD)offset;
+		overlapped.OffsetHigh = (DWORD)(offset >> 32);
+		DWORD read;
+		if (!ReadFile((HANDLE)_get_osfhandle(fd), p, (DWORD)n, &read, &overlapped))
+		{
+			if (GetLastError() == ERROR_HANDLE_EOF)
+				break;
+			throw std::runtime_error("Cannot read from file.");
+		}
+#else
+		auto read = pread(fd, p, n, (off_t)offset);
+		if (read < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			throw std::runtime_error("Cannot read from file.");
+		}
+#endif
+		if (read == 0)
+			break;
+		p += read;
+		bytes -= read;
+		offset += read;
+		total += read;
+	}
+	return total;
+}
+
+ParallelFileSink::ParallelFileSink(const std::string& path, const ParallelIOOptions& options)
+	: options(options), offset(0), buffer(options.bufferSize), buffered(0)
+{
+#ifdef _WIN32
+	fd = _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+	fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+	if (fd < 0)
+		throw std::runtime_error("Cannot open file \"" + path + "\" for writing.");
+}
+
+static int closeDescriptor(int fd)
+{
+#ifdef _WIN32
+	return _close(fd);
+#else
+	return ::close(fd);
+#endif
+}
+
+ParallelFileSink::~ParallelFileSink()
+{
+	try
+	{
+		close();
+	}
+	catch (std::exception& e)
+	{
+		std::cerr << "Error while closing parallel file sink: " << e.what() << std::endl;
+	}
+}
+
+void ParallelFileSink::close()
+{
+	if (fd < 0)
+		return;
+
+	int descriptor = fd;
+	try
+	{
+		flush();
+	}
+	catch (...)
+	{
+		fd = -1;
+		closeDescriptor(descriptor);
+		throw;
+	}
+	fd = -1;
+	if (closeDescriptor(descriptor) != 0)
+		throw std::runtime_error("Cannot close file.");
+}
+
+void ParallelFileSink::write(const void* data, size_t bytes)
+{
+	if (fd < 0)
+		throw std::runtime_error("The sink has already been closed.");
+	//empty arrays may pass a null pointer, which must not reach memcpy
+	if (bytes == 0)
+		return;
+	const char* p = static_cast<const char*>(data);
+	if (bytes < options.parallelThreshold)
+	{
+		if (buffered + bytes > buffer.size())
+			flush();
+		if (bytes >= buffer.size())
+		{
+			positionedWrite(fd, p, bytes, offset);
+			offset += bytes;
+		}
+		else
+		{
+			std::memcpy(buffer.data() + buffered, p, bytes);
+			buffered += bytes;
+		}
+		return;
+	}
+
+	flush();
+	size_t chunkSize = std::max<size_t>(1, options.chunkSize);
+	size_t chunks = (bytes + chunkSize - 1) / chunkSize;
+	uint64_t start = offset;
+	parallel_for_index(chunks, [&](size_t i)
+	{
+		size_t chunkOffset = i * chunkSize;
+		positionedWrite(fd, p + chunkOffset, std::min(chunkSize, bytes - chunkOffset), start + chunkOffset);
+	}, options.threads);
+	offset += bytes;
+}
+
+void ParallelFileSink::flush()
+{
+	if (buffered == 0)
+		return;
+	size_t n = buffered;
+	buffered = 0;
+	positionedWrite(fd, buffer.data(), n, offset);
+	offset += n;
+}
+
+ParallelFileSource::ParallelFileSource(const std::string& path, const ParallelIOOptions& options)
+	: options(options), offset(0), buffer(options.bufferSize), bufferBegin(0), bufferEnd(0)
+{
+#ifdef _WIN32
+	fd = _open(path.c_str(), _O_RDONLY | _O_BINARY);
+#else
+	fd = open(path.c_str(), O_RDONLY);
+#endif
+	if (fd < 0)
+		throw std::runtime_error("Cannot open file \"" + path + "\".");
+}
+
+ParallelFileSource::~ParallelFileSource()
+{
+#ifdef _WIN32
+	_close(fd);
+#else
+	close(fd);
+#endif
+}
+
+void ParallelFileSource::read(void* data, size_t bytes)
+{
+	if (bytes == 0)
+		return;
+	char* p = static_cast<char*>(data);
+
+	size_t fromBuffer = std::min(bytes, bufferEnd - bufferBegin);
+	std::memcpy(p, buffer.data() + bufferBegin, fromBuffer);
+	bufferBegin += fromBuffer;
+	p += fromBuffer;
+	bytes -= fromBuffer;
+	if (bytes == 0)
+		return;
+
+	if (bytes >= options.parallelThreshold)
+	{
+		size_t chunkSize = std::max<size_t>(1, options.chunkSize);
+		size_t chunks = (bytes + chunkSize - 1) / chunkSize;
+		uint64_t start = offset;
+		parallel_for_index(chunks, [&](size_t i)
+		{
+			size_t chunkOffset = i * chunkSize;
+			size_t n = std::min(chunkSize, bytes - chunkOffset);
+			if (positionedRead(fd, p + chunkOffset, n, start + chunkOffset) != n)
+				throw std::runtime_error("Cannot read enough data from file");
+		}, options.threads);
+		offset += bytes;
+		return;
+	}
+
+	if (bytes >= buffer.size())
+	{
+		if (positionedRead(fd, p, bytes, offset) != bytes)
+			throw std::runtime_error("Cannot read enough data from file");
+		offset += bytes;
+		return;
+	}
+
+	bufferBegin = 0;
+	bufferEnd = positionedRead(fd, buffer.data(), buffer.size(), offset);
+	offset += bufferEnd;
+	if (bufferEnd < bytes)
+		throw std::runtime_error("Cannot read enough data from file");
+	std::memcpy(p, buffer.data(), bytes);
+	bufferBegin = bytes;
+}
@@ -9,6 +9,8 @@
 
 #include "nsessentials/data/Parallelization.h"
 
+#include <deque>
+
 using namespace nse::data;
 
 ordered_lock::ordered_lock() : next_ticket(0), counter(0) {}
@@ -24,4 +26,107 @@ void ordered_lock::unlock()
 	std::unique_lock<std::mutex> acquire(cvar_lock);
 	counter++;
 	cvar.notify_all();
-}
\ No newline at end of file
+}
+#ifndef HAVE_TBB
+namespace
+{
+	class WorkerPool
+	{
+	public:
+		WorkerPool()
+			: stop(false)
+		{
+			unsigned int count = std::max(1u, std::thread::hardware_concurrency()) - 1;
+			for (unsigned int i = 0; i < count; ++i)
+				threads.emplace_back([this]() { run(); });
+		}
+
+		~WorkerPool()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stop = true;
+			}
+			available.notify_all();
+			for (auto& t : threads)
+				t.join();
+		}
+
+		unsigned int size() const { return (unsigned int)threads.size(); }
+
+		void submit(const std::shared_ptr<detail::ParallelJob>& job, size_t helpers)
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				for (size_t i = 0; i < helpers; ++i)
+					queue.push_back(job);
+			}
+			if (helpers == 1)
+				available.notify_one();
+			else
+				available.notify_all();
+		}
+
+	private:
+		void run()
+		{
+			while (true)
+			{
+				std::shared_ptr<detail::ParallelJob> job;
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					while (!stop && queue.empty())
+						available.wait(lock);
+					if (queue.empty())
+						return;
+					job = std::move(queue.front());
+					queue.pop_front();
+				}
+
+				{
+					std::lock_guard<std::mutex> lock(job->mutex);
+					if (job->closed)
+						continue;
+					++job->running;
+				}
+				job->work();
+				{
+					std::lock_guard<std::mutex> lock(job->mutex);
+					--job->running;
+				}
+				job->finished.notify_all();
+			}
+		}
+
+		std::vector<std::thread> threads;
+		std::deque<std::shared_ptr<detail::ParallelJob>> queue;
+		std::mutex mutex;
+		std::condition_variable available;
+		bool stop;
+	};
+
+	WorkerPool& workerPool()
+	{
+		static WorkerPool pool;
+		return pool;
+	}
+}
+
+unsigned int nse::data::detail::workerPoolSize()
+{
+	return workerPool().size();
+}
+
+void nse::data::detail::submitParallelJob(const std::shared_ptr<ParallelJob>& job, size_t helpers)
+{
+	workerPool().submit(job, helpers);
+}
+
+void nse::data::detail::finishParallelJob(ParallelJob& job)
+{
+	std::unique_lock<std::mutex> lock(job.mutex);
+	job.closed = true;
+	while (job.running > 0)
+		job.finished.wait(lock);
+}
+#endif
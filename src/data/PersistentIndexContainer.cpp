@@ -0,0 +1,16 @@
+/*
+	This file is part of NSEssentials.
+
+	Use of this source code is granted via a BSD-style license, which can be found
+	in License.txt in the repository root.
+
+	@author Nico Schertler
+*/
+
+#include "nsessentials/data/PersistentIndexContainer.h"
+
+using namespace nse::data;
+
+//Definitions of the constants, which are required if they are odr-used (e.g., bound to a const reference by std::min).
+const size_t PersistentSlotAllocator::DeletedIndex;
+const size_t PersistentSlotAllocator::MaxIncrementalDenseUpdates;
@@ -0,0 +1,285 @@
+/*
+	This file is part of NSEssentials.
+
+	Use of this source code is granted via a BSD-style license, which can be found
+	in License.txt in the repository root.
+
+	@author Nico Schertler
+*/
+
+#include "nsessentials/data/SectionedFile.h"
+#include "nsessentials/data/Hash.h"
+
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+
+using namespace nse::data;
+
+const char SectionedFileMagic[8] = { 'N', 'S', 'E', 'S', 'E', 'C', 'T', '\0' };
+
+//64-bit file positioning
+static int seek64(FILE* f, uint64_t offset)
+{
+#ifdef _WIN32
+	return _fseeki64(f, (__int64)offset, SEEK_SET);
+#else
+	return fseeko(f, (off_t)offset, SEEK_SET);
+#endif
+}
+
+static uint64_t tell64(FILE* f)
+{
+#ifdef _WIN32
+	return (uint64_t)_ftelli64(f);
+#else
+	return (uint64_t)ftello(f);
+#endif
+}
+
+//Calculates the checksum of the given file range. The file position is undefined afterwards.
+static uint64_t checksumOfRange(FILE* f, uint64_t offset, uint64_t size)
+{
+	if (seek64(f, offset) != 0)
+		throw std::runtime_error("Cannot seek in file");
+	std::vector<char> buffer(1 << 20); //multiple of 8 bytes such that hashes can be chained
+	uint64_t hash = hashBytes(nullptr, 0);
+	while (size > 0)
+	{
+		size_t chunk = (size_t)std::min<uint64_t>(size, buffer.size());
+		if (fread(buffer.data(), 1, chunk, f) != chunk)
+			throw std::runtime_error("Cannot read enough data from file");
+		hash = hashBytes(buffer.data(), chunk, hash);
+		size -= chunk;
+	}
+	return hash;
+}
+
+static void saveString(const std::string& s, SectionedFileWriter& f)
+{
+	uint32_t length = (uint32_t)s.size();
+	saveToFile(length, f);
+	f.write(s.data(), length);
+}
+
+static void loadString(std::string& s, FILE* f)
+{
+	uint32_t length;
+	loadFromFile(length, f);
+	s.resize(length);
+	if (length > 0 && fread(&s[0], 1, length, f) != length)
+		throw std::runtime_error("Cannot read enough data from file");
+}
+
+SectionedFileWriter::SectionedFileWriter(const std::string& path)
+	: inSection(false), position(0)
+{
+	file = fopen(path.c_str(), "wb");
+	if (file == nullptr)
+		throw std::runtime_error("Cannot open file \"" + path + "\" for writing.");
+
+	try
+	{
+		write(SectionedFileMagic, sizeof(SectionedFileMagic));
+		saveToFile(SectionedFileVersion, *this);
+		uint32_t reserved = 0;
+		saveToFile(reserved, *this);
+		uint64_t tocOffset = 0; //patched in close()
+		saveToFile(tocOffset, *this);
+	}
+	catch (...)
+	{
+		fclose(file);
+		throw;
+	}
+}
+
+SectionedFileWriter::~SectionedFileWriter()
+{
+	try
+	{
+		close();
+	}
+	catch (std::exception& e)
+	{
+		std::cerr << "Error while closing sectioned file: " << e.what() << std::endl;
+	}
+}
+
+void SectionedFileWriter::write(const void* data, size_t bytes)
+{
+	if (file == nullptr)
+		throw std::runtime_error("The sectioned file has already been closed.");
+	if (bytes == 0)
+		return;
+	if (fwrite(data, 1, bytes, file) != bytes)
+		throw std::runtime_error("Cannot write to sectioned file.");
+	if (inSection)
+		sectionHash.update(data, bytes);
+	position += bytes;
+}
+
+void SectionedFileWriter::beginSection(const std::string& name, uint32_t typeTag)
+{
+	if (inSection)
+		throw std::runtime_error("Cannot begin a section before the previous one has ended.");
+	for (auto& s : sections)
+		if (s.name == name)
+			throw std::runtime_error("Section \"" + name + "\" already exists.");
+
+	SectionInfo info;
+	info.name = name;
+	info.typeTag = typeTag;
+	info.offset = position;
+	info.size = 0;
+	info.checksum = 0;
+	sections.push_back(info);
+	sectionHash = IncrementalHash();
+	inSection = true;
+}
+
+void SectionedFileWriter::endSection()
+{
+	if (!inSection)
+		throw std::runtime_error("There is no section to end.");
+	inSection = false;
+
+	auto& info = sections.back();
+	info.size = position - info.offset;
+	info.checksum = sectionHash.value();
+}
+
+void SectionedFileWriter::close()
+{
+	if (file == nullptr)
+		return;
+
+	std::string error;
+	try
+	{
+		if (inSection)
+			endSection();
+
+		uint64_t tocOffset = position;
+		uint64_t count = sections.size();
+		saveToFile(count, *this);
+		for (auto& s : sections)
+		{
+			saveString(s.name, *this);
+			saveToFile(s.typeTag, *this);
+			saveToFile(s.offset, *this);
+			saveToFile(s.size, *this);
+			saveToFile(s.checksum, *this);
+		}
+
+		if (seek64(file, sizeof(SectionedFileMagic) + 2 * sizeof(uint32_t)) != 0)
+			throw std::runtime_error("Cannot seek in sectioned file.");
+		saveToFile(tocOffset, *this);
+	}
+	catch (std::exception& e)
+	{
+		error = e.what();
+	}
+
+	if ((fflush(file) != 0 || ferror(file) != 0) && error.empty())
+		error = "Cannot write to sectioned file.";
+	if (fclose(file) != 0 && error.empty())
+		error = "Cannot close sectioned file.";
+	file = nullptr;
+	if (!error.empty())
+		throw std::runtime_error(error);
+}
+
+SectionedFileReader::SectionedFileReader(const std::string& path)
+	: hashing(false)
+{
+	file = fopen(path.c_str(), "rb");
+	if (file == nullptr)
+		throw std::runtime_error("Cannot open file \"" + path + "\".");
+
+	try
+	{
+		char magic[sizeof(SectionedFileMagic)];
+		if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) || memcmp(magic, SectionedFileMagic, sizeof(magic)) != 0)
+			throw std::runtime_error("The file \"" + path + "\" is not a sectioned file.");
+		loadFromFile(_version, file);
+		if (_version > SectionedFileVersion)
+			throw std::runtime_error("The file \"" + path + "\" has been written by a newer version.");
+		uint32_t reserved;
+		loadFromFile(reserved, file);
+		uint64_t tocOffset;
+		loadFromFile(tocOffset, file);
+		if (tocOffset == 0)
+			throw std::runtime_error("The file \"" + path + "\" has not been closed properly.");
+
+		if (seek64(file, tocOffset) != 0)
+			throw std::runtime_error("Cannot seek to the table of contents of file \"" + path + "\".");
+		uint64_t count;
+		loadFromFile(count, file);
+		_sections.resize((size_t)count);
+		for (auto& s : _sections)
+		{
+			loadString(s.name, file);
+			loadFromFile(s.typeTag, file);
+			loadFromFile(s.offset, file);
+			loadFromFile(s.size, file);
+			loadFromFile(s.checksum, file);
+		}
+	}
+	catch (...)
+	{
+		fclose(file);
+		throw;
+	}
+}
+
+SectionedFileReader::~SectionedFileReader()
+{
+	fclose(file);
+}
+
+bool SectionedFileReader::hasSection(const std::string& name) const
+{
+	for (auto& s : _sections)
+		if (s.name == name)
+			return true;
+	return false;
+}
+
+const SectionInfo& SectionedFileReader::section(const std::string& name) const
+{
+	for (auto& s : _sections)
+		if (s.name == name)
+			return s;
+	throw std::runtime_error("The file does not contain a section \"" + name + "\".");
+}
+
+bool SectionedFileReader::verifySection(const std::string& name)
+{
+	auto& info = section(name);
+	return checksumOfRange(file, info.offset, info.size) == info.checksum;
+}
+
+const SectionInfo& SectionedFileReader::seekToSection(const std::string& name, uint32_t expectedTypeTag, bool verify)
+{
+	auto& info = section(name);
+	if (expectedTypeTag != 0 && info.typeTag != expectedTypeTag)
+		throw std::runtime_error("Section \"" + name + "\" has an unexpected type.");
+	if (verify && !verifySection(name))
+		throw std::runtime_error("Section \"" + name + "\" is corrupt.");
+	if (seek64(file, info.offset) != 0)
+		throw std::runtime_error("Cannot seek in file");
+	return info;
+}
+
+void SectionedFileReader::read(void* data, size_t bytes)
+{
+	readBytes(file, data, bytes);
+	if (hashing)
+		sectionHash.update(data, bytes);
+}
+
+uint64_t SectionedFileReader::position()
+{
+	return tell64(file);
+}
@@ -0,0 +1,228 @@
+/*
+	This file is part of NSEssentials.
+
+	Use of this source code is granted via a BSD-style license, which can be found
+	in License.txt in the repository root.
+
+	@author Nico Schertler
+*/
+
+#include "nsessentials/data/SharedMemory.h"
+
+#include <cstring>
+#include <atomic>
+#include <algorithm>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace nse::data;
+
+//Layout of the region: header (padded to HeaderSize bytes), payload
+struct SharedMemoryHeader
+{
+	char magic[8];
+	uint64_t payloadSize;
+	uint64_t complete;
+};
+
+static const size_t HeaderSize = 64;
+const char SharedMemoryMagic[8] = { 'N', 'S', 'E', 'S', 'H', 'M', '\0', '\0' };
+
+SharedMemoryWriter::SharedMemoryWriter(const std::string& name, size_t initialCapacity)
+	: name(name), mapping(nullptr), capacity(0), payloadSize(0)
+{
+#ifdef _WIN32
+	capacity = HeaderSize + initialCapacity;
+	mappingHandle = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+		(DWORD)((uint64_t)capacity >> 32), (DWORD)capacity, name.c_str());
+	if (mappingHandle == nullptr)
+		throw std::runtime_error("Cannot create shared memory \"" + name + "\".");
+	mapping = static_cast<char*>(MapViewOfFile(mappingHandle, FILE_MAP_ALL_ACCESS, 0, 0, capacity));
+	if (mapping == nullptr)
+	{
+		CloseHandle(mappingHandle);
+		throw std::runtime_error("Cannot map shared memory \"" + name + "\".");
+	}
+#else
+	//replace an existing region such that attached readers keep their old content
+	shm_unlink(name.c_str());
+	fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+	if (fd < 0)
+		throw std::runtime_error("Cannot create shared memory \"" + name + "\".");
+	try
+	{
+		reserve(initialCapacity);
+	}
+	catch (...)
+	{
+		::close(fd);
+		shm_unlink(name.c_str());
+		throw;
+	}
+#endif
+	std::memset(mapping, 0, HeaderSize);
+}
+
+SharedMemoryWriter::~SharedMemoryWriter()
+{
+	try
+	{
+		close();
+	}
+	catch (...)
+	{ }
+#ifdef _WIN32
+	CloseHandle(mappingHandle);
+#endif
+}
+
+void SharedMemoryWriter::reserve(size_t payloadBytes)
+{
+	size_t required = HeaderSize + payloadBytes;
+	if (required <= capacity)
+		return;
+#ifdef _WIN32
+	throw std::runtime_error("The shared memory \"" + name + "\" is full.");
+#else
+	//the mapping only contains data that is owned by the writer, so it can be moved
+	size_t newCapacity = std::max(required, 2 * capacity);
+	if (ftruncate(fd, (off_t)newCapacity) != 0)
+		throw std::runtime_error("Cannot resize shared memory \"" + name + "\".");
+	if (mapping != nullptr)
+		munmap(mapping, capacity);
+	void* m = mmap(nullptr, newCapacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (m == MAP_FAILED)
+	{
+		mapping = nullptr;
+		capacity = 0;
+		throw std::runtime_error("Cannot map shared memory \"" + name + "\".");
+	}
+	mapping = static_cast<char*>(m);
+	capacity = newCapacity;
+#endif
+}
+
+void SharedMemoryWriter::write(const void* data, size_t bytes)
+{
+	if (mapping == nullptr)
+		throw std::runtime_error("The shared memory \"" + name + "\" has already been closed.");
+	reserve(payloadSize + bytes);
+	if (bytes > 0)
+		std::memcpy(mapping + HeaderSize + payloadSize, data, bytes);
+	payloadSize += bytes;
+}
+
+void SharedMemoryWriter::align(size_t alignment)
+{
+	size_t padding = (alignment - payloadSize % alignment) % alignment;
+	if (padding == 0)
+		return;
+	if (mapping == nullptr)
+		throw std::runtime_error("The shared memory \"" + name + "\" has already been closed.");
+	reserve(payloadSize + padding);
+	std::memset(mapping + HeaderSize + payloadSize, 0, padding);
+	payloadSize += padding;
+}
+
+void SharedMemoryWriter::close()
+{
+	if (mapping == nullptr)
+		return;
+
+	auto header = reinterpret_cast<SharedMemoryHeader*>(mapping);
+	std::memcpy(header->magic, SharedMemoryMagic, sizeof(SharedMemoryMagic));
+	header->payloadSize = payloadSize;
+	//the payload must be visible before the region is marked as complete
+	std::atomic_thread_fence(std::memory_order_release);
+	header->complete = 1;
+
+#ifdef _WIN32
+	UnmapViewOfFile(mapping);
+	mapping = nullptr;
+#else
+	munmap(mapping, capacity);
+	mapping = nullptr;
+	//release the unused capacity
+	bool truncated = ftruncate(fd, (off_t)(HeaderSize + payloadSize)) == 0;
+	::close(fd);
+	if (!truncated)
+		throw std::runtime_error("Cannot resize shared memory \"" + name + "\".");
+#endif
+}
+
+void SharedMemoryWriter::remove(const std::string& name)
+{
+#ifndef _WIN32
+	shm_unlink(name.c_str());
+#endif
+}
+
+SharedMemoryReader::SharedMemoryReader(const std::string& name)
+	: mapping(nullptr), mappingSize(0)
+{
+#ifdef _WIN32
+	mappingHandle = OpenFileMappingA(FILE_MAP_READ, FALSE, name.c_str());
+	if (mappingHandle == nullptr)
+		throw std::runtime_error("Cannot open shared memory \"" + name + "\".");
+	mapping = static_cast<const char*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+	if (mapping == nullptr)
+	{
+		CloseHandle(mappingHandle);
+		throw std::runtime_error("Cannot map shared memory \"" + name + "\".");
+	}
+	MEMORY_BASIC_INFORMATION info;
+	VirtualQuery(mapping, &info, sizeof(info));
+	mappingSize = info.RegionSize;
+#else
+	int fd = shm_open(name.c_str(), O_RDONLY, 0);
+	if (fd < 0)
+		throw std::runtime_error("Cannot open shared memory \"" + name + "\".");
+	struct stat s;
+	if (fstat(fd, &s) != 0 || (size_t)s.st_size < HeaderSize)
+	{
+		::close(fd);
+		throw std::runtime_error("Shared memory \"" + name + "\" is incomplete.");
+	}
+	mappingSize = (size_t)s.st_size;
+	void* m = mmap(nullptr, mappingSize, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (m == MAP_FAILED)
+		throw std::runtime_error("Cannot map shared memory \"" + name + "\".");
+	mapping = static_cast<const char*>(m);
+#endif
+
+	auto header = reinterpret_cast<const SharedMemoryHeader*>(mapping);
+	bool valid = mappingSize >= HeaderSize && std::memcmp(header->magic, SharedMemoryMagic, sizeof(SharedMemoryMagic)) == 0
+		&& header->complete == 1;
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if (!valid || header->payloadSize > mappingSize - HeaderSize)
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(mapping);
+		CloseHandle(mappingHandle);
+#else
+		munmap(const_cast<char*>(mapping), mappingSize);
+#endif
+		throw std::runtime_error("Shared memory \"" + name + "\" is incomplete.");
+	}
+	payload = mapping + HeaderSize;
+	payloadSize = (size_t)header->payloadSize;
+}
+
+SharedMemoryReader::~SharedMemoryReader()
+{
+#ifdef _WIN32
+	UnmapViewOfFile(mapping);
+	CloseHandle(mappingHandle);
+#else
+	munmap(const_cast<char*>(mapping), mappingSize);
+#endif
+}
@@ -0,0 +1,199 @@
+/*
+	This file is part of NSEssentials.
+
+	Use of this source code is granted via a BSD-style license, which can be found
+	in License.txt in the repository root.
+
+	@author Nico Schertler
+*/
+
+#include "nsessentials/data/Streams.h"
+
+#include <stdexcept>
+#include <cerrno>
+#include <algorithm>
+#include <iostream>
+#include <fcntl.h>
+
+#ifdef _WIN32
+#include <io.h>
+#include <sys/stat.h>
+#define NSE_OPEN_WRITE_FLAGS (_O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY)
+#define NSE_OPEN_READ_FLAGS (_O_RDONLY | _O_BINARY)
+#define NSE_OPEN_MODE (_S_IREAD | _S_IWRITE)
+#else
+#include <unistd.h>
+#define NSE_OPEN_WRITE_FLAGS (O_WRONLY | O_CREAT | O_TRUNC)
+#define NSE_OPEN_READ_FLAGS (O_RDONLY)
+#define NSE_OPEN_MODE 0644
+#endif
+
+using namespace nse::data;
+
+//Maximum number of bytes that are passed to a single read() or write() call
+static const size_t MaxTransfer = 1 << 30;
+
+FileDescriptorSink::FileDescriptorSink(const std::string& path, size_t bufferSize)
+	: ownsDescriptor(true), closed(false), buffer(bufferSize), buffered(0)
+{
+	fd = ::open(path.c_str(), NSE_OPEN_WRITE_FLAGS, NSE_OPEN_MODE);
+	if (fd < 0)
+		throw std::runtime_error("Cannot open file \"" + path + "\" for writing.");
+}
+
+FileDescriptorSink::FileDescriptorSink(int fd, size_t bufferSize)
+	: fd(fd), ownsDescriptor(false), closed(false), buffer(bufferSize), buffered(0)
+{ }
+
+FileDescriptorSink::~FileDescriptorSink()
+{
+	try
+	{
+		close();
+	}
+	catch (std::exception& e)
+	{
+		std::cerr << "Error while closing file descriptor sink: " << e.what() << std::endl;
+	}
+}
+
+void FileDescriptorSink::close()
+{
+	if (closed)
+		return;
+	closed = true;
+
+	try
+	{
+		flush();
+	}
+	catch (...)
+	{
+		if (ownsDescriptor)
+			::close(fd);
+		throw;
+	}
+	if (ownsDescriptor && ::close(fd) != 0)
+		throw std::runtime_error("Cannot close file descriptor.");
+}
+
+void FileDescriptorSink::write(const void* data, size_t bytes)
+{
+	if (closed)
+		throw std::runtime_error("The sink has already been closed.");
+	//empty arrays may pass a null pointer, which must not reach memcpy
+	if (bytes == 0)
+		return;
+	const char* p = static_cast<const char*>(data);
+	if (buffered + bytes <= buffer.size())
+	{
+		std::memcpy(buffer.data() + buffered, p, bytes);
+		buffered += bytes;
+		return;
+	}
+	flush();
+	if (bytes >= buffer.size())
+		writeToDescriptor(p, bytes);
+	else
+	{
+		std::memcpy(buffer.data(), p, bytes);
+		buffered = bytes;
+	}
+}
+
+void FileDescriptorSink::flush()
+{
+	size_t n = buffered;
+	buffered = 0;
+	writeToDescriptor(buffer.data(), n);
+}
+
+void FileDescriptorSink::writeToDescriptor(const char* data, size_t bytes)
+{
+	while (bytes > 0)
+	{
+		auto written = ::write(fd, data, (unsigned int)std::min(bytes, MaxTransfer));
+		if (written < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			throw std::runtime_error("Cannot write to file descriptor.");
+		}
+		data += written;
+		bytes -= written;
+	}
+}
+
+FileDescriptorSource::FileDescriptorSource(const std::string& path, size_t bufferSize)
+	: ownsDescriptor(true), buffer(bufferSize), bufferBegin(0), bufferEnd(0)
+{
+	fd = ::open(path.c_str(), NSE_OPEN_READ_FLAGS);
+	if (fd < 0)
+		throw std::runtime_error("Cannot open file \"" + path + "\".");
+}
+
+FileDescriptorSource::FileDescriptorSource(int fd, size_t bufferSize)
+	: fd(fd), ownsDescriptor(false), buffer(bufferSize), bufferBegin(0), bufferEnd(0)
+{ }
+
+FileDescriptorSource::~FileDescriptorSource()
+{
+	if (ownsDescriptor)
+		::close(fd);
+}
+
+void FileDescriptorSource::read(void* data, size_t bytes)
+{
+	if (bytes == 0)
+		return;
+	char* p = static_cast<char*>(data);
+
+	//serve from the buffer first
+	size_t fromBuffer = std::min(bytes, bufferEnd - bufferBegin);
+	std::memcpy(p, buffer.data() + bufferBegin, fromBuffer);
+	bufferBegin += fromBuffer;
+	p += fromBuffer;
+	bytes -= fromBuffer;
+
+	if (bytes >= buffer.size())
+	{
+		//large reads go directly to the destination
+		while (bytes > 0)
+		{
+			size_t n = readFromDescriptor(p, bytes);
+			if (n == 0)
+				throw std::runtime_error("Cannot read enough data from file");
+			p += n;
+			bytes -= n;
+		}
+		return;
+	}
+
+	while (bytes > 0)
+	{
+		bufferBegin = 0;
+		bufferEnd = readFromDescriptor(buffer.data(), buffer.size());
+		if (bufferEnd == 0)
+			throw std::runtime_error("Cannot read enough data from file");
+		size_t n = std::min(bytes, bufferEnd);
+		std::memcpy(p, buffer.data(), n);
+		bufferBegin = n;
+		p += n;
+		bytes -= n;
+	}
+}
+
+size_t FileDescriptorSource::readFromDescriptor(char* data, size_t bytes)
+{
+	while (true)
+	{
+		auto n = ::read(fd, data, (unsigned int)std::min(bytes, MaxTransfer));
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			throw std::runtime_error("Cannot read from file descriptor.");
+		}
+		return (size_t)n;
+	}
+}
@@ -99,6 +99,19 @@ void GLBuffer::uploadData(uint32_t size, const void *data)
 	glBufferData(BufferTargets[type], size, data, GL_DYNAMIC_DRAW);
 }
 
+void GLBuffer::uploadSubData(size_t offset, size_t bytes, const void *data)
+{
+	if (id == 0)
+		throw std::runtime_error("The specified buffer has no storage to update.");
+
+	if (bytes == 0)
+		return;
+
+	bind();
+
+	glBufferSubData(BufferTargets[type], offset, bytes, data);
+}
+
 void GLBuffer::downloadData(uint32_t size, int /* dim */,
 	uint32_t compSize, GLuint /* glType */, uint8_t *data)
 {
@@ -10,10 +10,9 @@ using namespace nse::util;
 void UnionFind::SaveToFile(const char* filename) const
 {
 	FILE* file = fopen(filename, "wb");
-	uint64_t entries = size();
-	fwrite(&entries, sizeof(uint64_t), 1, file);
-	fwrite(&parentIndices[0], sizeof(index_t), parentIndices.size(), file);
-	fwrite(&ranks[0], sizeof(unsigned int), ranks.size(), file);
+	if (file == nullptr)
+		throw std::runtime_error("Cannot open file for writing");
+	Save(file);
 	fclose(file);
 }
 
@@ -22,17 +21,18 @@ std::size_t UnionFind::size() const { return parentIndices.size(); }
 // Loads the entire structure from a file. Existing data in the structure is overridden.
 void UnionFind::LoadFromFile(const char* filename)
 {
-	uint64_t entries;
-
 	FILE* file = fopen(filename, "rb");
-	if(fread(&entries, sizeof(uint64_t), 1, file) != 1)
-		throw std::runtime_error("Cannot read enough data from file");
-	parentIndices.resize(entries);
-	ranks.resize(entries);
-	if(fread(&parentIndices[0], sizeof(index_t), entries, file) != entries)
-		throw std::runtime_error("Cannot read enough data from file");
-	if(fread(&ranks[0], sizeof(unsigned int), entries, file) != entries)
-		throw std::runtime_error("Cannot read enough data from file");
+	if (file == nullptr)
+		throw std::runtime_error("Cannot open file");
+	try
+	{
+		Load(file);
+	}
+	catch (...)
+	{
+		fclose(file);
+		throw;
+	}
 	fclose(file);
 }
 